@@ -0,0 +1,99 @@
+#pragma once
+
+// Collect per-keycode cycle counts in process_record_user and matrix_scan_user
+// using the DWT cycle counter. The `Stats` key on the FKEYS layer prints them;
+// needs CONSOLE_ENABLE = yes.
+// #define NEO2_PROFILE
+
+// Print one `KL:` line per key event for recording typing sessions with
+// `qmk console`; needs CONSOLE_ENABLE = yes.
+// #define NEO2_TRACE
+
+// Unicode input method used by the UC output engine (IBus on Linux).
+#define UNICODE_SELECTED_MODES UC_LNX
+
+// Acceleration profile of the NEO_1 mouse cluster. Reports are sent every
+// MOUSEKEY_INTERVAL ms regardless of the scan rate; QMK scales diagonal
+// movement by 1/sqrt(2).
+#define NEO2_MOUSE_CONSTANT 0  // fixed speed, no acceleration
+#define NEO2_MOUSE_LINEAR   1  // linear ramp up to the maximum speed
+#define NEO2_MOUSE_KINETIC  2  // quadratic ramp, fast across 4K screens
+#define NEO2_MOUSE_PROFILE  NEO2_MOUSE_KINETIC
+
+#define MOUSEKEY_INTERVAL 8
+
+#if NEO2_MOUSE_PROFILE == NEO2_MOUSE_CONSTANT
+#  define MK_3_SPEED
+#  define MK_C_OFFSET_UNMOD   24
+#  define MK_C_INTERVAL_UNMOD MOUSEKEY_INTERVAL
+#  define MK_W_OFFSET_UNMOD   1
+#  define MK_W_INTERVAL_UNMOD 40
+#elif NEO2_MOUSE_PROFILE == NEO2_MOUSE_LINEAR
+#  define MOUSEKEY_DELAY       100
+#  define MOUSEKEY_MOVE_DELTA  4
+#  define MOUSEKEY_MAX_SPEED   12
+#  define MOUSEKEY_TIME_TO_MAX 60
+#elif NEO2_MOUSE_PROFILE == NEO2_MOUSE_KINETIC
+#  define MK_KINETIC_SPEED
+#  define MOUSEKEY_DELAY              5
+#  define MOUSEKEY_MOVE_DELTA         16
+#  define MOUSEKEY_INITIAL_SPEED      200
+#  define MOUSEKEY_BASE_SPEED         8000
+#  define MOUSEKEY_DECELERATED_SPEED  400
+#  define MOUSEKEY_ACCELERATED_SPEED  3000
+#else
+#  error "NEO2_MOUSE_PROFILE must be one of the NEO2_MOUSE_* profiles"
+#endif
+
+// Dual-role keys, see get_tapping_term() and friends in keymap.c
+#define TAPPING_TERM_PER_KEY
+#define HOLD_ON_OTHER_KEY_PRESS_PER_KEY
+#define PERMISSIVE_HOLD_PER_KEY
+#define RETRO_TAPPING_PER_KEY
+#define NEO2_LMOD3_TAPPING_TERM 180
+#define YELDIR_AC_TAPPING_TERM  220
+
+// Count key presses per (layer, row, col) and log layer transitions. The
+// `Stats` key on the FKEYS layer prints them; needs CONSOLE_ENABLE = yes.
+// #define NEO2_HEATMAP
+
+// Idle time in ms after the last mode change before the settings are
+// written to EEPROM.
+#define NEO2_SETTINGS_WRITE_DELAY 5000
+
+// Poll at 1 kHz; with the eager per-key debounce from rules.mk a press is
+// reported in the scan that sees it.
+#define USB_POLLING_INTERVAL_MS 1
+
+// Flash available to the compose sequence trie, in bytes.
+#define NEO2_COMPOSE_FLASH_BUDGET 256
+
+// Key events shared by both dynamic macro slots and the delay between
+// replayed events in milliseconds.
+#define DYNAMIC_MACRO_SIZE 256
+#define DYNAMIC_MACRO_DELAY 2
+// process_record_user() calls process_dynamic_macro() itself to keep the
+// held keys and layer holds across a playback.
+#define DYNAMIC_MACRO_USER_CALL
+
+// All layers fit into 8 bits. Shrinks layer_state_t and the per-key source
+// layer cache, and the core's layer walk checks 8 instead of 32 layer bits.
+#define LAYER_STATE_8BIT
+
+// Auto-repeat of the NEO_4 arrows and PgUp/PgDn, in ms: first repeat after
+// the delay, then every interval, shrinking by the acceleration per repeat
+// down to the minimum interval.
+#define NEO2_NAV_REPEAT_DELAY        250
+#define NEO2_NAV_REPEAT_INTERVAL     40
+#define NEO2_NAV_REPEAT_INTERVAL_MIN 10
+#define NEO2_NAV_REPEAT_ACCEL        2
+
+// Size budgets in bytes, checked at compile time at the end of keymap.c.
+// A feature that grows past its budget fails the build.
+#define NEO2_BUDGET_LAYER_FLASH      256   // one keymaps[] layer
+#define NEO2_BUDGET_KEYMAPS_FLASH    1536  // all of keymaps[]
+#define NEO2_BUDGET_KEY_TABLES_FLASH 192   // shifted digits, numpad, navigation
+#define NEO2_BUDGET_UNICODE_FLASH    512   // NEO_3 symbols and NEO_5/NEO_6 codepoints
+#define NEO2_BUDGET_STATE_RAM        64    // always-on keymap state
+#define NEO2_BUDGET_PROFILE_RAM      3072  // NEO2_PROFILE statistics
+#define NEO2_BUDGET_HEATMAP_RAM      2048  // NEO2_HEATMAP counters and ring
@@ -4,11 +4,7 @@
 #include "action_layer.h"
 #include "version.h"
 #include "layers.h"
-
-// State bitmap to track which key(s) enabled NEO_3 layer
-static uint8_t neo3_state = 0;
-// State bitmap to track key combo for CAPSLOCK
-static uint8_t capslock_state = 0;
+#include "raw_hid.h"
 
 // bitmasks for modifier keys
 #define MODS_NONE   0
@@ -20,11 +16,9 @@ static uint8_t capslock_state = 0;
 // Used to trigger macros / sequences of keypresses
 enum custom_keycodes {
   PLACEHOLDER = SAFE_RANGE,     // can always be here
-  NEO2_LMOD3,
   NEO2_RMOD3,
-  YELDIR_AC,
-  YELDIR_CTLTAB,
-  YELDIR_CTLSTAB,
+  NEO2_LMOD4,
+  NEO2_RMOD4,
   NEO2_1,
   NEO2_2,
   NEO2_3,
@@ -38,46 +32,161 @@ enum custom_keycodes {
   NEO2_MINUS,
   NEO2_COMMA,
   NEO2_DOT,
-  NEO2_SHARP_S
+  NEO2_SHARP_S,
+  // NEO_3/NEO_4 symbols, see unicode_symbols[]
+  NEO2_L3_RSAQUO,
+  NEO2_L3_LSAQUO,
+  NEO2_L3_CENT,
+  NEO2_L3_YEN,
+  NEO2_L3_SBQUO,
+  NEO2_L3_LEFT_SINGLE_QUOTE,
+  NEO2_L3_RIGHT_SINGLE_QUOTE,
+  NEO2_L3_ELLIPSIS,
+  NEO2_L3_CIRCUMFLEX,
+  NEO2_L3_SMALL_LONG_S,
+  NEO2_L3_BACKTICK,
+  NEO2_L3_FEMININE_ORDINAL,
+  NEO2_L3_MASCULINE_ORDINAL,
+  NEO2_L3_NUMERO_SIGN,
+  NEO2_L3_MIDDLE_DOT,
+  NEO2_L3_BRITISH_POUND,
+  NEO2_L3_CURRENCY_SIGN,
+  NEO2_L3_INV_EXCLAMATION,
+  NEO2_L3_INV_QUESTIONMARK,
+  NEO2_L3_EM_DASH,
+  // NEO_5/NEO_6 symbols, see layer_symbols[]
+  NEO2_L5_SUBSCRIPT_1,
+  NEO2_L5_SUBSCRIPT_2,
+  NEO2_L5_SUBSCRIPT_3,
+  NEO2_L5_FEMALE,
+  NEO2_L5_MALE,
+  NEO2_L5_MALE_FEMALE,
+  NEO2_L5_KAPPA_SYMBOL,
+  NEO2_L5_LANGLE,
+  NEO2_L5_RANGLE,
+  NEO2_L5_SUBSCRIPT_0,
+  NEO2_L5_NB_HYPHEN,
+  NEO2_L5_XI,
+  NEO2_L5_LAMBDA,
+  NEO2_L5_CHI,
+  NEO2_L5_OMEGA,
+  NEO2_L5_KAPPA,
+  NEO2_L5_PSI,
+  NEO2_L5_GAMMA,
+  NEO2_L5_PHI,
+  NEO2_L5_PHI_SYMBOL,
+  NEO2_L5_FINAL_SIGMA,
+  NEO2_L5_IOTA,
+  NEO2_L5_ALPHA,
+  NEO2_L5_EPSILON,
+  NEO2_L5_OMICRON,
+  NEO2_L5_SIGMA,
+  NEO2_L5_NU,
+  NEO2_L5_RHO,
+  NEO2_L5_TAU,
+  NEO2_L5_DELTA,
+  NEO2_L5_UPSILON,
+  NEO2_L5_LUNATE_EPSILON,
+  NEO2_L5_ETA,
+  NEO2_L5_PI,
+  NEO2_L5_ZETA,
+  NEO2_L5_BETA,
+  NEO2_L5_MU,
+  NEO2_L5_RHO_SYMBOL,
+  NEO2_L5_THETA_SYMBOL,
+  NEO2_L5_THETA,
+  NEO2_L6_NOT,
+  NEO2_L6_OR,
+  NEO2_L6_AND,
+  NEO2_L6_UP_TACK,
+  NEO2_L6_ANGLE,
+  NEO2_L6_PARALLEL,
+  NEO2_L6_RIGHT_ARROW,
+  NEO2_L6_INFINITY,
+  NEO2_L6_PROPORTIONAL,
+  NEO2_L6_EMPTY_SET,
+  NEO2_L6_DASHED_LINE,
+  NEO2_L6_CAPITAL_XI,
+  NEO2_L6_SQUARE_ROOT,
+  NEO2_L6_CAPITAL_LAMBDA,
+  NEO2_L6_COMPLEX,
+  NEO2_L6_CAPITAL_OMEGA,
+  NEO2_L6_TIMES,
+  NEO2_L6_CAPITAL_PSI,
+  NEO2_L6_CAPITAL_GAMMA,
+  NEO2_L6_CAPITAL_PHI,
+  NEO2_L6_RATIONAL,
+  NEO2_L6_RING,
+  NEO2_L6_SUBSET,
+  NEO2_L6_INTEGRAL,
+  NEO2_L6_FOR_ALL,
+  NEO2_L6_EXISTS,
+  NEO2_L6_ELEMENT_OF,
+  NEO2_L6_CAPITAL_SIGMA,
+  NEO2_L6_NATURAL,
+  NEO2_L6_REAL,
+  NEO2_L6_PARTIAL,
+  NEO2_L6_CAPITAL_DELTA,
+  NEO2_L6_NABLA,
+  NEO2_L6_UNION,
+  NEO2_L6_INTERSECTION,
+  NEO2_L6_ALEF,
+  NEO2_L6_CAPITAL_PI,
+  NEO2_L6_INTEGERS,
+  NEO2_L6_LEFT_DOUBLE_ARROW,
+  NEO2_L6_LEFT_RIGHT_DOUBLE_ARROW,
+  NEO2_L6_RIGHT_DOUBLE_ARROW,
+  NEO2_L6_MAPS_TO,
+  NEO2_L6_CAPITAL_THETA,
+  // NEO_4 numpad, see numpad_keys[]
+  NEO2_NUM_0,
+  NEO2_NUM_1,
+  NEO2_NUM_2,
+  NEO2_NUM_3,
+  NEO2_NUM_4,
+  NEO2_NUM_5,
+  NEO2_NUM_6,
+  NEO2_NUM_7,
+  NEO2_NUM_8,
+  NEO2_NUM_9,
+  NEO2_NUM_COMMA,
+  NEO2_NUM_SLASH,
+  NEO2_NUM_ASTERISK,
+  NEO2_NUM_MINUS,
+  NEO2_NUM_PLUS,
+  NEO2_NAV_UP,
+  NEO2_NAV_DOWN,
+  NEO2_NAV_LEFT,
+  NEO2_NAV_RIGHT,
+  NEO2_NAV_PGUP,
+  NEO2_NAV_PGDN,
+  NEO2_COMPOSE,
+  NEO2_UNICODE_TOGGLE,
+  NEO2_NUMPAD_TOGGLE,
+  NEO2_DUMP_STATS,
+  CUSTOM_KEYCODES_END
 };
 
-#define NEO2_LMOD4                   MO(NEO_4)
-#define NEO2_RMOD4                   NEO2_LMOD4
+// Mod3 on hold, Escape on tap. Holds go through the layer hold tracker.
+#define NEO2_LMOD3                   LT(NEO_3, KC_ESC)
 
 // Use _______ to indicate a key that is transparent / falling through to a lower level
 #define _______ KC_TRNS
 
 // NEO_3 special characters
-#define NEO2_L3_CAPITAL_SS           RSA(DE_S)                   // ẞ
 #define NEO2_L3_CAPITAL_UE           S(DE_UDIA)                  // Ü
 #define NEO2_L3_CAPITAL_OE           S(DE_ODIA)                  // Ö
 #define NEO2_L3_CAPITAL_AE           S(DE_ADIA)                  // Ä
-#define NEO2_L3_SUPERSCRIPT_1        RALT(DE_1)                  // ¹
 #define NEO2_L3_SUPERSCRIPT_2        DE_SUP2                     // ²
 #define NEO2_L3_SUPERSCRIPT_3        DE_SUP3                     // ³
-#define NEO2_L3_RSAQUO               RSA(DE_Y)                   // ›
-#define NEO2_L3_LSAQUO               RSA(DE_X)                   // ‹
-#define NEO2_L3_RAQUO                RALT(DE_Y)                  // »  TODO: remove this
-#define NEO2_L3_LAQUO                RALT(DE_X)                  // «  TODO: remove this
-#define NEO2_L3_CENT                 RALT(DE_C)                  // ¢  TODO: remove this
-#define NEO2_L3_YEN                  RSA(DE_Z)                   // ¥  TODO: remove this
-#define NEO2_L3_SBQUO                RSA(DE_V)                   // ‚  TODO: remove this
-#define NEO2_L3_LEFT_SINGLE_QUOTE    RSA(DE_B)                   // ‘  TODO: remove this
-#define NEO2_L3_RIGHT_SINGLE_QUOTE   RSA(DE_N)                   // ’  TODO: remove this
-#define NEO2_L3_LOW9_DBQUOTE         RALT(DE_V)                  // „  TODO: remove this
-#define NEO2_L3_LEFT_DBQUOTE         RALT(DE_B)                  // “  TODO: remove this
-#define NEO2_L3_RIGHT_DBQUOTE        RALT(DE_N)                  // ”  TODO: remove this
-#define NEO2_L3_ELLIPSIS             RALT(DE_DOT)                // …
 #define NEO2_L3_UNDERSCORE           DE_UNDS                     // _
 #define NEO2_L3_LBRACKET             DE_LBRC                     // [
 #define NEO2_L3_RBRACKET             DE_RBRC                     // ]
-#define NEO2_L3_CIRCUMFLEX           DE_CIRC                     // ^
 #define NEO2_L3_EXCLAMATION          DE_EXLM                     // !
 #define NEO2_L3_LESSTHAN             DE_LABK                     // <
 #define NEO2_L3_GREATERTHAN          DE_RABK                     // >
 #define NEO2_L3_EQUAL                DE_EQL                      // =
 #define NEO2_L3_AMPERSAND            DE_AMPR                     // &
-#define NEO2_L3_SMALL_LONG_S         RALT(DE_S)                  // ſ  TODO: remove this
 #define NEO2_L3_BSLASH               DE_BSLS                     // (backslash)
 #define NEO2_L3_SLASH                DE_SLSH                     // /
 #define NEO2_L3_CLBRACKET            DE_LCBR                     // {
@@ -92,7 +201,6 @@ enum custom_keycodes {
 #define NEO2_L3_HASH                 DE_HASH                     // #
 #define NEO2_L3_PIPE                 DE_PIPE                     // |
 #define NEO2_L3_TILDE                DE_TILD                     // ~
-#define NEO2_L3_BACKTICK             DE_GRV                      // `
 #define NEO2_L3_PLUS                 DE_PLUS                     // +
 #define NEO2_L3_PERCENT              DE_PERC                     // %
 #define NEO2_L3_DOUBLE_QUOTE         DE_DQUO                     // "
@@ -100,22 +208,71 @@ enum custom_keycodes {
 #define NEO2_L3_SEMICOLON            DE_SCLN                     // ;
 
 // NEO_4 special characters
-#define NEO2_L3_FEMININE_ORDINAL     RSA(DE_F)                   // ª  TODO: remove this
-#define NEO2_L3_MASCULINE_ORDINAL    RSA(DE_M)                   // º  TODO: remove this
-#define NEO2_L3_NUMERO_SIGN          KC_NO                       // №  TODO: remove this
-#define NEO2_L3_MIDDLE_DOT           RALT(DE_COMM)               // ·
-#define NEO2_L3_BRITISH_POUND        RSA(DE_3)                   // £  TODO: remove this
-#define NEO2_L3_CURRENCY_SIGN        RSA(DE_4)                   // ¤  TODO: remove this
-#define NEO2_L3_INV_EXCLAMATION      RSA(DE_1)                   // ¡
-#define NEO2_L3_INV_QUESTIONMARK     RSA(DE_SS)                  // ¿
 #define NEO2_L3_DOLLAR               DE_DLR                      // $
-#define NEO2_L3_EN_DASH              RALT(DE_MINS)               // –  TODO: remove this
-#define NEO2_L3_EM_DASH              RSA(DE_MINS)                // —  TODO: remove this
 
 // My own special things
+#define YELDIR_AC                    LCA_T(KC_TAB)               // left ctrl+alt on hold, tab on tap
+#define YELDIR_CTLTAB                LCTL(KC_TAB)
+#define YELDIR_CTLSTAB               LCTL(LSFT(KC_TAB))
 #define YELDIR_MOVETABLEFT           LCTL(LSFT(KC_PGDN))
 #define YELDIR_MOVETABRIGHT          LCTL(LSFT(KC_PGUP))
 
+// Always-on state of the keymap. It lives in one struct so that
+// NEO2_BUDGET_STATE_RAM covers every byte of it, and starts zeroed.
+static struct {
+  // Highest active layer, updated in layer_state_set_user
+  uint8_t current_layer;
+  // Layer state seen by the last layer_state_set_user call
+  layer_state_t last_layer_state;
+  // Bitmap per layer of the sources currently holding it. A layer stays on
+  // as long as at least one of its sources is held.
+  uint8_t layer_holds[FKEYS + 1];
+  // Whether another key was pressed since NEO2_LMOD3 was held.
+  bool lmod3_interrupted;
+  // State bitmap to track key combo for CAPSLOCK
+  uint8_t capslock_state;
+  // Host lock LEDs as last reported through led_update_user
+  led_t host_leds;
+  // Indicator LEDs currently switched on, bit n for LED n.
+  uint8_t indicator_leds;
+
+  // Output engine for the NEO_3/NEO_4 symbols: false emulates them with
+  // AltGr combinations and dead keys of the QWERTZ host layout, true types
+  // the codepoint through the Unicode input method.
+  bool unicode_output;
+  // Numpad mode of NEO_4: false sends the main block keys of the QWERTZ
+  // host layout, true sends keypad keys.
+  bool keypad_numpad;
+  // Bit n set while NEO2_NUM_0 + n is held after being pressed as a keypad
+  // key, so it is released as the same key after a mode change.
+  uint16_t numpad_keypad_held;
+  // Whether DE_NORMAL was the active mode at the last layer change.
+  bool de_normal_mode;
+  bool settings_dirty;
+  uint16_t settings_timer;
+
+  // Held navigation keys as nav_keys[] indices in press order. The last
+  // one is repeated by nav_repeat().
+  uint8_t nav_held[NEO2_NAV_PGDN - NEO2_NAV_UP + 1];
+  uint8_t nav_held_count;
+  uint16_t nav_timer;
+  uint16_t nav_interval;
+
+  // Siblings the next key of a compose sequence is matched against, no
+  // sequence is in progress while compose_count is 0.
+  uint8_t compose_first;
+  uint8_t compose_count;
+
+  // Key events passed to process_record_user since power-up.
+  uint32_t key_events;
+  // Whether a key was down at the last scan, and whether the last key went
+  // up at the last scan.
+  bool keys_were_down;
+  bool idle_check_pending;
+} neo2;
+
+_Static_assert(NEO_1 == 0, "neo2.current_layer starts out as NEO_1");
+
 const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   /* NEO_1: Basic layer
    *
@@ -124,16 +281,16 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
    * |  TAB   |   X  |   V  |   L  |   C  |   W  | MOVE |           | MOVE |   K  |   H  |   G  |   F  |   Q  |   ß    |
    * |--------+------+------+------+------+------| TAB<-|           | TAB->|------+------+------+------+------+--------|
-   * |  NEO3  |   U  |   I  |   A  |   E  |   O  |------|           |------|   S  |   N  |   R  |   T  |   D  |   Y    |
+   * |NEO3/Esc|   U  |   I  |   A  |   E  |   O  |------|           |------|   S  |   N  |   R  |   T  |   D  |   Y    |
    * |--------+------+------+------+------+------| MB1  |           | MB2  |------+------+------+------+------+--------|
    * | LSHIFT |   Ü  |   Ö  |   Ä  |   P  |   Z  |      |           |      |   B  |   M  |  ,/– |  ./• |   J  | RSHIFT |
    * `--------+------+------+------+------+-------------'           `-------------+------+------+------+------+--------'
    *   | MWLF | MWDN | MWUP | MWRI | NEO4 |                                       | NEO4 | MLEF | MDOW | MUP  | MRIG |
    *   `----------------------------------'                                       `----------------------------------'
    *                                        ,-------------.       ,-------------.
-   *                                        | APP  |ctrl+s|       | ---- | FKEY |
+   *                                        | APP  |ctrl+s|       | NEO3 | FKEY |
    *                                 ,------|------|------|       |------+------+------.
-   *                                 |      |      | AC   |       | AC   |      |      |
+   *                                 |      |      |AC/Tab|       |AC/Tab|      |      |
    *                                 | LGUI | LALT |------|       |------| ALTG |Space |
    *                                 |      |      | LCTRL|       | RCTRL|      |      |
    *                                 `--------------------'       `--------------------'
@@ -159,7 +316,7 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /* --- */         /* --- */         NEO2_RMOD4,       KC_MS_LEFT,       KC_MS_DOWN,       KC_MS_UP,         KC_MS_RIGHT,
 
     // right hand side - thumb cluster
-    KC_NO,            MO(FKEYS),        /* --- */
+    NEO2_RMOD3,       MO(FKEYS),        /* --- */
     YELDIR_AC,        /* --- */         /* --- */
     KC_RCTL,          KC_RALT,          KC_SPACE
   ),
@@ -169,7 +326,7 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    * ,--------------------------------------------------.           ,--------------------------------------------------.
    * |  ----  | ---- | ---- | ---- |   ›  |   ‹  |      |           |      |   ¢ 	|   ¥  |   ‚  |   ‘  |   ’  |  ----  |
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
-   * |  ----  |   …  |   _  |   [  |   ]  |   ^  | MOVE |           | MOVE |   !  |   <  |   >  |   =  |   &  |  ----  |
+   * |   ♫    |   …  |   _  |   [  |   ]  |   ^  | MOVE |           | MOVE |   !  |   <  |   >  |   =  |   &  |  ----  |
    * |--------+------+------+------+------+------| TAB<-|           | TAB->|------+------+------+------+------+--------|
    * |        |   \  |   /  |   {  |   }  |   *  |------|           |------|   ?  |   (  |   )  |   -  |   :  |   @    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
@@ -188,7 +345,7 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   [NEO_3] = LAYOUT_ergodox(
     // left hand side - main
     KC_NO /* NOOP */,   KC_NO /* NOOP */,      KC_NO /* NOOP */,      KC_NO /* NOOP */,      NEO2_L3_RSAQUO,            NEO2_L3_LSAQUO,                _______,
-    KC_NO /* NOOP */,   NEO2_L3_ELLIPSIS,      NEO2_L3_UNDERSCORE,    NEO2_L3_LBRACKET,      NEO2_L3_RBRACKET,          NEO2_L3_CIRCUMFLEX,            YELDIR_MOVETABLEFT,
+    NEO2_COMPOSE,       NEO2_L3_ELLIPSIS,      NEO2_L3_UNDERSCORE,    NEO2_L3_LBRACKET,      NEO2_L3_RBRACKET,          NEO2_L3_CIRCUMFLEX,            YELDIR_MOVETABLEFT,
     _______,            NEO2_L3_BSLASH,        NEO2_L3_SLASH,         NEO2_L3_CLBRACKET,     NEO2_L3_CRBRACKET,         NEO2_L3_ASTERISK,              /* --- */
     _______,            NEO2_L3_HASH,          NEO2_L3_DOLLAR,        NEO2_L3_PIPE,          NEO2_L3_TILDE,             NEO2_L3_BACKTICK,              _______,
     _______,            _______,               _______,               _______,               _______,                   /* --- */                      /* --- */
@@ -214,9 +371,9 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   /* NEO_4: Cursor & Numpad
    *
    * ,--------------------------------------------------.           ,--------------------------------------------------.
-   * |  ----  |   ª  |   º  | ---- |   ·  |   £  |      |           |      | ---- | Tab  |   /  |   *  |   -  |  ----  |
+   * |  ----  |   ª  |   º  |   №  |   ·  |   £  |      |           |      | ---- | Tab  |   /  |   *  |   -  |  ----  |
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
-   * |  ----  | PgUp |   ⌫  |  Up  |   ⌦  | PgDn |      |           |      |   ¡  |   7  |   8  |   9  |   +  |   –    |
+   * |  ----  | PgUp |   ⌫  |  Up  |   ⌦  | PgDn |      |           |      |   ¡  |   7  |   8  |   9  |   +  |   —    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
    * |        | Home | Left | Down | Right| End  |------|           |------|   ¿  |   4  |   5  |   6  |   ,  |   .    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
@@ -234,9 +391,9 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    */
   [NEO_4] = LAYOUT_ergodox(
     // left hand side - main
-    KC_NO /* NOOP */,   NEO2_L3_FEMININE_ORDINAL, NEO2_L3_MASCULINE_ORDINAL,KC_NO /* NOOP */,     NEO2_L3_MIDDLE_DOT, NEO2_L3_BRITISH_POUND, _______,
-    _______,            KC_PGUP,                  KC_BSPC,                  KC_UP,                KC_DELETE,          KC_PGDN,               _______,
-    _______,            KC_HOME,                  KC_LEFT,                  KC_DOWN,              KC_RIGHT,           KC_END,                /* --- */
+    KC_NO /* NOOP */,   NEO2_L3_FEMININE_ORDINAL, NEO2_L3_MASCULINE_ORDINAL,NEO2_L3_NUMERO_SIGN,  NEO2_L3_MIDDLE_DOT, NEO2_L3_BRITISH_POUND, _______,
+    _______,            NEO2_NAV_PGUP,            KC_BSPC,                  NEO2_NAV_UP,          KC_DELETE,          NEO2_NAV_PGDN,         _______,
+    _______,            KC_HOME,                  NEO2_NAV_LEFT,            NEO2_NAV_DOWN,        NEO2_NAV_RIGHT,     KC_END,                /* --- */
     _______,            KC_ESCAPE,                KC_TAB,                   KC_INSERT,            KC_ENTER,           KC_NO /* NOOP */,      _______,
     _______,            _______,                  _______,                  _______,              _______,            /* --- */              /* --- */
 
@@ -246,11 +403,11 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     _______,            _______,                  _______,
 
     // right hand side - main
-    _______,            NEO2_L3_CURRENCY_SIGN,     KC_TAB,                   NEO2_L3_SLASH,     DE_ASTR,         DE_MINS,              KC_NO /* NOOP */,
-    _______,            NEO2_L3_INV_EXCLAMATION,   KC_7,                     KC_8,              KC_9,            DE_PLUS,              NEO2_L3_EM_DASH,
-    /* --- */           NEO2_L3_INV_QUESTIONMARK,  KC_4,                     KC_5,              KC_6,            DE_COMM,              KC_DOT,
-    _______,            NEO2_L3_COLON,             KC_1,                     KC_2,              KC_3,            NEO2_L3_SEMICOLON,    _______,
-    /* --- */           /* --- */                 _______,                   KC_0,              _______,         _______,              _______,
+    _______,            NEO2_L3_CURRENCY_SIGN,     KC_TAB,                   NEO2_NUM_SLASH,    NEO2_NUM_ASTERISK, NEO2_NUM_MINUS,    KC_NO /* NOOP */,
+    _______,            NEO2_L3_INV_EXCLAMATION,   NEO2_NUM_7,               NEO2_NUM_8,        NEO2_NUM_9,        NEO2_NUM_PLUS,     NEO2_L3_EM_DASH,
+    /* --- */           NEO2_L3_INV_QUESTIONMARK,  NEO2_NUM_4,               NEO2_NUM_5,        NEO2_NUM_6,        NEO2_NUM_COMMA,    KC_DOT,
+    _______,            NEO2_L3_COLON,             NEO2_NUM_1,               NEO2_NUM_2,        NEO2_NUM_3,        NEO2_L3_SEMICOLON, _______,
+    /* --- */           /* --- */                 _______,                   NEO2_NUM_0,        _______,           _______,           _______,
 
     // right hand side - thumb cluster
     _______,            _______,                  /* --- */
@@ -261,13 +418,13 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   /* NEO_5: Greek
    *
    * ,--------------------------------------------------.           ,--------------------------------------------------.
-   * |  ----  | ---- | ---- | ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |  ----  |   ₁  |   ₂  |   ₃  |   ♀  |   ♂  |      |           |      |   ⚥  |   ϰ  |   ⟨  |   ⟩  |   ₀  |   ‑    |
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
-   * |  ----  | ---- | ---- | ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |  ----  |   ξ  | ---- |   λ  |   χ  |   ω  |      |           |      |   κ  |   ψ  |   γ  |   φ  |   ϕ  |   ς    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
-   * |        | ---- |  ----| ---- | ---- | ---- |------|           |------| ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |        | ---- |   ι  |   α  |   ε  |   ο  |------|           |------|   σ  |   ν  |   ρ  |   τ  |   δ  |   υ    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
-   * |        | ---- |  ----| ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |        |
+   * |        | ---- |   ϵ  |   η  |   π  |   ζ  |      |           |      |   β  |   μ  |   ϱ  |   ϑ  |   θ  |        |
    * `--------+------+------+------+------+-------------'           `-------------+------+------+------+------+--------'
    *   |      |      |      |      |      |                                       |      |      |      |      |      |
    *   `----------------------------------'                                       `----------------------------------'
@@ -281,40 +438,40 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    */
   [NEO_5] = LAYOUT_ergodox(
     // left hand side - main
-    KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   /* --- */
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    _______,            _______,            _______,            _______,              _______,            /* --- */           /* --- */
+    KC_NO /* NOOP */,   NEO2_L5_SUBSCRIPT_1, NEO2_L5_SUBSCRIPT_2,    NEO2_L5_SUBSCRIPT_3, NEO2_L5_FEMALE,       NEO2_L5_MALE,        _______,
+    KC_NO /* NOOP */,   NEO2_L5_XI,          KC_NO /* NOOP */,       NEO2_L5_LAMBDA,      NEO2_L5_CHI,          NEO2_L5_OMEGA,       _______,
+    _______,            KC_NO /* NOOP */,    NEO2_L5_IOTA,           NEO2_L5_ALPHA,       NEO2_L5_EPSILON,      NEO2_L5_OMICRON,     /* --- */
+    _______,            KC_NO /* NOOP */,    NEO2_L5_LUNATE_EPSILON, NEO2_L5_ETA,         NEO2_L5_PI,           NEO2_L5_ZETA,        _______,
+    _______,            _______,             _______,                _______,             _______,              /* --- */            /* --- */
 
     // left hand side - thumb cluster
-    /* --- */           _______,            _______,
-    /* --- */           /* --- */           _______,
-    _______,            _______,            _______,
+    /* --- */           _______,             _______,
+    /* --- */           /* --- */            _______,
+    _______,            _______,             _______,
 
     // right hand side - main
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    /* --- */           KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    /* --- */           /* --- */           _______,            _______,              _______,            _______,            _______,
+    _______,            NEO2_L5_MALE_FEMALE, NEO2_L5_KAPPA_SYMBOL,   NEO2_L5_LANGLE,      NEO2_L5_RANGLE,       NEO2_L5_SUBSCRIPT_0, NEO2_L5_NB_HYPHEN,
+    _______,            NEO2_L5_KAPPA,       NEO2_L5_PSI,            NEO2_L5_GAMMA,       NEO2_L5_PHI,          NEO2_L5_PHI_SYMBOL,  NEO2_L5_FINAL_SIGMA,
+    /* --- */           NEO2_L5_SIGMA,       NEO2_L5_NU,             NEO2_L5_RHO,         NEO2_L5_TAU,          NEO2_L5_DELTA,       NEO2_L5_UPSILON,
+    _______,            NEO2_L5_BETA,        NEO2_L5_MU,             NEO2_L5_RHO_SYMBOL,  NEO2_L5_THETA_SYMBOL, NEO2_L5_THETA,       _______,
+    /* --- */           /* --- */            _______,                _______,             _______,              _______,             _______,
 
     // right hand side - thumb cluster
-    _______,            _______,            /* --- */
-    _______,            /* --- */           /* --- */
-    _______,            _______,            _______
+    _______,            _______,             /* --- */
+    _______,            /* --- */            /* --- */
+    _______,            _______,             _______
   ),
 
   /* NEO_6: Math symbols
    *
    * ,--------------------------------------------------.           ,--------------------------------------------------.
-   * |  ----  | ---- | ---- | ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |  ----  |   ¬  |   ∨  |   ∧  |   ⊥  |   ∡  |      |           |      |   ∥  |   →  |   ∞  |   ∝  |   ∅  |   ╌    |
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
-   * |  ----  | ---- | ---- | ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |  ----  |   Ξ  |   √  |   Λ  |   ℂ  |   Ω  |      |           |      |   ×  |   Ψ  |   Γ  |   Φ  |   ℚ  |   ∘    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
-   * |        | ---- |  ----| ---- | ---- | ---- |------|           |------| ---- | ---- | ---- | ---- | ---- |  ----  |
+   * |        |   ⊂  |   ∫  |   ∀  |   ∃  |   ∈  |------|           |------|   Σ  |   ℕ  |   ℝ  |   ∂  |   Δ  |   ∇    |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
-   * |        | ---- |  ----| ---- | ---- | ---- |      |           |      | ---- | ---- | ---- | ---- | ---- |        |
+   * |        |   ∪  |   ∩  |   ℵ  |   Π  |   ℤ  |      |           |      |   ⇐  |   ⇔  |   ⇒  |   ↦  |   Θ  |        |
    * `--------+------+------+------+------+-------------'           `-------------+------+------+------+------+--------'
    *   |      |      |      |      |      |                                       |      |      |      |      |      |
    *   `----------------------------------'                                       `----------------------------------'
@@ -328,28 +485,28 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    */
   [NEO_6] = LAYOUT_ergodox(
     // left hand side - main
-    KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   /* --- */
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    _______,            _______,            _______,            _______,              _______,            /* --- */           /* --- */
+    KC_NO /* NOOP */,   NEO2_L6_NOT,               NEO2_L6_OR,                      NEO2_L6_AND,                NEO2_L6_UP_TACK,      NEO2_L6_ANGLE,         _______,
+    KC_NO /* NOOP */,   NEO2_L6_CAPITAL_XI,        NEO2_L6_SQUARE_ROOT,             NEO2_L6_CAPITAL_LAMBDA,     NEO2_L6_COMPLEX,      NEO2_L6_CAPITAL_OMEGA, _______,
+    _______,            NEO2_L6_SUBSET,            NEO2_L6_INTEGRAL,                NEO2_L6_FOR_ALL,            NEO2_L6_EXISTS,       NEO2_L6_ELEMENT_OF,    /* --- */
+    _______,            NEO2_L6_UNION,             NEO2_L6_INTERSECTION,            NEO2_L6_ALEF,               NEO2_L6_CAPITAL_PI,   NEO2_L6_INTEGERS,      _______,
+    _______,            _______,                   _______,                         _______,                    _______,              /* --- */              /* --- */
 
     // left hand side - thumb cluster
-    /* --- */           _______,            _______,
-    /* --- */           /* --- */           _______,
-    _______,            _______,            _______,
+    /* --- */           _______,                   _______,
+    /* --- */           /* --- */                  _______,
+    _______,            _______,                   _______,
 
     // right hand side - main
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    /* --- */           KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,
-    _______,            KC_NO /* NOOP */,   KC_NO /* NOOP */,   KC_NO /* NOOP */,     KC_NO /* NOOP */,   KC_NO /* NOOP */,   _______,
-    /* --- */           /* --- */           _______,            _______,              _______,            _______,            _______,
+    _______,            NEO2_L6_PARALLEL,          NEO2_L6_RIGHT_ARROW,             NEO2_L6_INFINITY,           NEO2_L6_PROPORTIONAL, NEO2_L6_EMPTY_SET,     NEO2_L6_DASHED_LINE,
+    _______,            NEO2_L6_TIMES,             NEO2_L6_CAPITAL_PSI,             NEO2_L6_CAPITAL_GAMMA,      NEO2_L6_CAPITAL_PHI,  NEO2_L6_RATIONAL,      NEO2_L6_RING,
+    /* --- */           NEO2_L6_CAPITAL_SIGMA,     NEO2_L6_NATURAL,                 NEO2_L6_REAL,               NEO2_L6_PARTIAL,      NEO2_L6_CAPITAL_DELTA, NEO2_L6_NABLA,
+    _______,            NEO2_L6_LEFT_DOUBLE_ARROW, NEO2_L6_LEFT_RIGHT_DOUBLE_ARROW, NEO2_L6_RIGHT_DOUBLE_ARROW, NEO2_L6_MAPS_TO,      NEO2_L6_CAPITAL_THETA, _______,
+    /* --- */           /* --- */                  _______,                         _______,                    _______,              _______,               _______,
 
     // right hand side - thumb cluster
-    _______,            _______,            /* --- */
-    _______,            /* --- */           /* --- */
-    _______,            _______,            _______
+    _______,            _______,                   /* --- */
+    _______,            /* --- */                  /* --- */
+    _______,            _______,                   _______
   ),
 
   /* DE_NORMAL: DE QWERTZ
@@ -404,11 +561,11 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
    * ,--------------------------------------------------.           ,--------------------------------------------------.
    * |  Prev  |  F1  |  F2  |  F3  |  F4  |  F5  |  F11 |           |  F12 |  F6  |  F7  |  F8  |  F9  |  F10 |  VolUp |
    * |--------+------+------+------+------+-------------|           |------+------+------+------+------+------+--------|
-   * |  Play  |      |      |      |      |      |      |           |      |      |      |      |      |      |  VolDn |
+   * |  Play  | Rec1 | Ply1 | Rec2 | Ply2 | Stop |      |           |      |      |      |      |      |      |  VolDn |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
    * |  Next  |      |      |      |      |      |------|           |------|      |      |      |      |      |  Mute  |
    * |--------+------+------+------+------+------|      |           |      |------+------+------+------+------+--------|
-   * |        |      |      |      |      |      |      |           |      |      |      |      |      |      |        |
+   * | Stats  |  UC  |  KP  |      |      |      |      |           |      |      |      |      |      |      |        |
    * `--------+------+------+------+------+-------------'           `-------------+------+------+------+------+--------'
    *   |      |      |      |      |      |                                       |      |      |      |      |      |
    *   `----------------------------------'                                       `----------------------------------'
@@ -423,9 +580,9 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   [FKEYS] = LAYOUT_ergodox(
     // left hand side - main
     KC_MEDIA_REWIND,        KC_F1,              KC_F2,              KC_F3,                KC_F4,              KC_F5,              KC_F11,
-    KC_MEDIA_PLAY_PAUSE,    _______,            _______,            _______,              _______,            _______,            _______,
+    KC_MEDIA_PLAY_PAUSE,    DM_REC1,            DM_PLY1,            DM_REC2,              DM_PLY2,            DM_RSTP,            _______,
     KC_MEDIA_FAST_FORWARD,  _______,            _______,            _______,              _______,            _______,            /* --- */
-    _______,                _______,            _______,            _______,              _______,            _______,            _______,
+    NEO2_DUMP_STATS,        NEO2_UNICODE_TOGGLE, NEO2_NUMPAD_TOGGLE, _______,             _______,            _______,            _______,
     _______,                _______,            _______,            _______,              _______,            /* --- */           /* --- */
 
     // left hand side - thumb cluster
@@ -447,6 +604,198 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
   ),
 };
 
+_Static_assert(sizeof(keymaps) / sizeof(keymaps[0]) == FKEYS + 1,
+               "keymaps[] must define exactly the layers of layers.h");
+_Static_assert(FKEYS < MAX_LAYER, "layers.h outgrew layer_state_t, drop LAYER_STATE_8BIT");
+
+#ifdef NEO2_PROFILE
+#ifdef __arm__
+#include <hal.h>
+
+// The DWT cycle counter, enabled in matrix_init_user().
+#define PROFILE_CLOCK() DWT->CYCCNT
+#define PROFILE_UNIT "cycles"
+#else
+#include <time.h>
+
+// Host builds (test/) have no cycle counter and measure nanoseconds.
+static uint32_t profile_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+
+#define PROFILE_CLOCK() profile_clock()
+#define PROFILE_UNIT "ns"
+#endif
+
+// Cycle statistics, one slot per custom keycode followed by the aggregate slots.
+enum profile_slots {
+  PROFILE_SLOT_OTHER = CUSTOM_KEYCODES_END - PLACEHOLDER,
+  PROFILE_SLOT_EVENT,
+  PROFILE_SLOT_SHIFTED,
+  PROFILE_SLOT_SCAN,
+  PROFILE_SLOT_COUNT
+};
+
+static const char *const profile_slot_names[] = { "other", "event", "shifted", "scan" };
+
+typedef struct {
+  uint32_t min;
+  uint32_t max;
+  uint32_t total;
+  uint32_t count;
+} profile_stat_t;
+
+static profile_stat_t profile_stats[PROFILE_SLOT_COUNT];
+
+// Timestamps of the first and last key event since the last dump.
+static uint32_t profile_first_event;
+static uint32_t profile_last_event;
+
+#define PROFILE_START() uint32_t profile_start = PROFILE_CLOCK()
+#define PROFILE_STOP(slot) profile_record((slot), PROFILE_CLOCK() - profile_start)
+#define PROFILE_STOP_EVENT(slot) profile_record_event((slot), PROFILE_CLOCK() - profile_start)
+
+static uint8_t profile_slot_for(uint16_t keycode) {
+  if (keycode >= PLACEHOLDER && keycode < CUSTOM_KEYCODES_END) {
+    return keycode - PLACEHOLDER;
+  }
+  return PROFILE_SLOT_OTHER;
+}
+
+static void profile_record(uint8_t slot, uint32_t cycles) {
+  profile_stat_t *stat = &profile_stats[slot];
+
+  if (stat->count == 0 || cycles < stat->min) stat->min = cycles;
+  if (cycles > stat->max) stat->max = cycles;
+  stat->total += cycles;
+  stat->count++;
+}
+
+// Record a whole key event, in its own slot and in the event total.
+static void profile_record_event(uint8_t slot, uint32_t cycles) {
+  profile_record(slot, cycles);
+  profile_record(PROFILE_SLOT_EVENT, cycles);
+
+  profile_last_event = timer_read32();
+  if (profile_stats[PROFILE_SLOT_EVENT].count == 1) {
+    profile_first_event = profile_last_event;
+  }
+}
+
+// Print min/avg/max cycles of every slot that saw at least one sample and
+// the event rate, then start over so every typing run is measured alone.
+static void profile_dump(void) {
+  for (uint8_t slot = 0; slot < PROFILE_SLOT_COUNT; slot++) {
+    const profile_stat_t *stat = &profile_stats[slot];
+    if (stat->count == 0) continue;
+
+    if (slot < PROFILE_SLOT_OTHER) {
+      uprintf("PROF: kc: 0x%04X", PLACEHOLDER + slot);
+    } else {
+      uprintf("PROF: %s", profile_slot_names[slot - PROFILE_SLOT_OTHER]);
+    }
+    uprintf(", n: %lu, min: %lu, avg: %lu, max: %lu\n", (unsigned long)stat->count,
+            (unsigned long)stat->min, (unsigned long)(stat->total / stat->count), (unsigned long)stat->max);
+  }
+
+  const profile_stat_t *events = &profile_stats[PROFILE_SLOT_EVENT];
+  uint32_t elapsed = profile_last_event - profile_first_event;
+  if (events->count > 1 && elapsed > 0) {
+    uprintf("PROF: run: %lu events in %lu ms, %lu events/s, worst: %lu " PROFILE_UNIT "\n",
+            (unsigned long)events->count, (unsigned long)elapsed,
+            (unsigned long)((events->count - 1) * 1000 / elapsed), (unsigned long)events->max);
+  }
+
+  for (uint8_t slot = 0; slot < PROFILE_SLOT_COUNT; slot++) {
+    profile_stats[slot] = (profile_stat_t){0};
+  }
+}
+#else
+#define PROFILE_START()
+#define PROFILE_STOP(slot)
+#define PROFILE_STOP_EVENT(slot)
+#endif
+
+#ifdef NEO2_HEATMAP
+// Key presses per (layer, row, col), saturating at UINT16_MAX.
+static uint16_t heatmap_presses[sizeof(keymaps) / sizeof(keymaps[0])][MATRIX_ROWS][MATRIX_COLS];
+
+// Layer transition as seen by layer_state_set_user.
+typedef struct {
+  uint16_t time;
+  uint8_t  from;
+  uint8_t  to;
+} layer_transition_t;
+
+// Single producer (layer_state_set_user), single consumer (heatmap_dump)
+// ring buffer. New transitions are dropped while it is full.
+#define HEATMAP_TRANSITIONS 64
+_Static_assert((HEATMAP_TRANSITIONS & (HEATMAP_TRANSITIONS - 1)) == 0,
+               "HEATMAP_TRANSITIONS must be a power of two");
+static layer_transition_t heatmap_transitions[HEATMAP_TRANSITIONS];
+static uint8_t heatmap_head = 0;
+static uint8_t heatmap_tail = 0;
+static uint16_t heatmap_dropped = 0;
+
+// Counted on the layer the key resolves to, so a transparent key lands on
+// the layer below the active one. The core has already looked that up for
+// the press and stored it in the source layer cache.
+static inline void heatmap_record_press(keypos_t key) {
+  if (key.row < MATRIX_ROWS && key.col < MATRIX_COLS) {
+    uint16_t *presses = &heatmap_presses[read_source_layers_cache(key)][key.row][key.col];
+    if (*presses != UINT16_MAX) (*presses)++;
+  }
+}
+
+static void heatmap_record_transition(uint8_t from, uint8_t to) {
+  uint8_t next = (heatmap_head + 1) & (HEATMAP_TRANSITIONS - 1);
+
+  if (next == heatmap_tail) {
+    heatmap_dropped++;
+    return;
+  }
+
+  heatmap_transitions[heatmap_head] = (layer_transition_t){ timer_read(), from, to };
+  heatmap_head = next;
+}
+
+// Print the non-zero press counters and drain the transition buffer.
+static void heatmap_dump(void) {
+  for (uint8_t layer = 0; layer < sizeof(heatmap_presses) / sizeof(heatmap_presses[0]); layer++) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        if (heatmap_presses[layer][row][col]) {
+          uprintf("HEAT: layer: %u, row: %2u, col: %2u, n: %u\n",
+                  layer, row, col, heatmap_presses[layer][row][col]);
+        }
+      }
+    }
+  }
+
+  while (heatmap_tail != heatmap_head) {
+    const layer_transition_t *transition = &heatmap_transitions[heatmap_tail];
+    uprintf("LAYER: time: %5u, from: %u, to: %u\n", transition->time, transition->from, transition->to);
+    heatmap_tail = (heatmap_tail + 1) & (HEATMAP_TRANSITIONS - 1);
+  }
+  if (heatmap_dropped) {
+    uprintf("LAYER: dropped: %u\n", heatmap_dropped);
+    heatmap_dropped = 0;
+  }
+}
+#endif
+
+// Print the collected statistics over the console.
+static void dump_stats(void) {
+#ifdef NEO2_PROFILE
+  profile_dump();
+#endif
+#ifdef NEO2_HEATMAP
+  heatmap_dump();
+#endif
+}
+
 // Send a key tap with a optional set of modifiers.
 void tap_with_modifiers(uint16_t keycode, uint8_t force_modifiers) {
   uint8_t active_modifiers = get_mods();
@@ -465,231 +814,1071 @@ void tap_with_modifiers(uint16_t keycode, uint8_t force_modifiers) {
   if ((force_modifiers & MODS_GUI) && !(active_modifiers & MODS_GUI)) unregister_code(KC_LGUI);
 }
 
+// Modifier masks used in the emission table
+#define EM_SHIFT  MOD_BIT(KC_LSFT)
+#define EM_ALTGR  MOD_BIT(KC_RALT)
+
+// Unshifted and shifted emission of a NEO2_1 ... NEO2_SHARP_S key as
+// (modifier mask, keycode) pairs for the german QWERTZ host layout.
+typedef struct {
+  uint8_t mods;
+  uint8_t keycode;
+  uint8_t shifted_mods;
+  uint8_t shifted_keycode;
+} shifted_emission_t;
+
+// Indexed by keycode - NEO2_1. This and the other keycode tables below
+// are positional, one entry per keycode in enum order, so a missing or
+// extra entry changes the element count their _Static_assert checks.
+static const shifted_emission_t PROGMEM shifted_emissions[] = {
+  { 0, KC_1,     EM_SHIFT,            KC_GRAVE },  // NEO2_1       1 °
+  { 0, KC_2,     EM_SHIFT,            KC_3     },  // NEO2_2       2 §
+  { 0, KC_3,     EM_ALTGR,            KC_1     },  // NEO2_3       3 ¹
+  { 0, KC_4,     EM_ALTGR,            KC_Z     },  // NEO2_4       4 »
+  { 0, KC_5,     EM_ALTGR,            KC_X     },  // NEO2_5       5 «
+  { 0, KC_6,     EM_SHIFT,            KC_4     },  // NEO2_6       6 $
+  { 0, KC_7,     EM_ALTGR,            KC_E     },  // NEO2_7       7 €
+  { 0, KC_8,     EM_ALTGR,            KC_V     },  // NEO2_8       8 „
+  { 0, KC_9,     EM_ALTGR,            KC_B     },  // NEO2_9       9 “
+  { 0, KC_0,     EM_ALTGR,            KC_N     },  // NEO2_0       0 ”
+  { 0, KC_SLASH, EM_SHIFT | EM_ALTGR, KC_SLASH },  // NEO2_MINUS   - —
+  { 0, KC_COMMA, EM_ALTGR,            KC_SLASH },  // NEO2_COMMA   , –
+  { 0, KC_DOT,   EM_ALTGR,            KC_COMMA },  // NEO2_DOT     . •
+  { 0, KC_MINS,  EM_SHIFT | EM_ALTGR, KC_S     },  // NEO2_SHARP_S ß ẞ
+};
+
+_Static_assert(sizeof(shifted_emissions) / sizeof(shifted_emissions[0]) == NEO2_SHARP_S - NEO2_1 + 1,
+               "shifted_emissions[] needs an entry for every key from NEO2_1 to NEO2_SHARP_S");
+
+// Tap keycode with exactly the given modifiers applied. This costs at most
+// three reports: modifiers plus key, key released, previous modifiers
+// restored. The restore is skipped when the modifiers did not change.
+static void tap_code_with_exact_mods(uint8_t keycode, uint8_t mods) {
+  uint8_t active_modifiers = get_mods();
+
+  set_mods(mods);
+  register_code(keycode);
+  unregister_code(keycode);
+
+  if (mods != active_modifiers) {
+    set_mods(active_modifiers);
+    send_keyboard_report();
+  }
+}
+
+// Send the table entry for a NEO2_1 ... NEO2_SHARP_S key. The shifted
+// variant replaces the active modifiers for the duration of the tap, the
+// unshifted one adds to them.
+static void emit_shifted_emission(uint16_t keycode, uint8_t active_modifiers) {
+  const shifted_emission_t *emission = &shifted_emissions[keycode - NEO2_1];
+
+  if (active_modifiers & MODS_SHIFT) {
+    tap_code_with_exact_mods(pgm_read_byte(&emission->shifted_keycode),
+                             pgm_read_byte(&emission->shifted_mods));
+  } else {
+    tap_code_with_exact_mods(pgm_read_byte(&emission->keycode),
+                             active_modifiers | pgm_read_byte(&emission->mods));
+  }
+}
+
+// Codepoint and QWERTZ emulation of a NEO2_L3_* symbol key. Dead keys are
+// followed by a space to get the bare character.
+typedef struct {
+  uint16_t codepoint;
+  uint16_t legacy;
+  bool     dead;
+} unicode_symbol_t;
+
+// Indexed by keycode - NEO2_L3_RSAQUO.
+static const unicode_symbol_t PROGMEM unicode_symbols[] = {
+  { 0x203A, RSA(DE_Y),     false },  // NEO2_L3_RSAQUO             ›
+  { 0x2039, RSA(DE_X),     false },  // NEO2_L3_LSAQUO             ‹
+  { 0x00A2, RALT(DE_C),    false },  // NEO2_L3_CENT               ¢
+  { 0x00A5, RSA(DE_Z),     false },  // NEO2_L3_YEN                ¥
+  { 0x201A, RSA(DE_V),     false },  // NEO2_L3_SBQUO              ‚
+  { 0x2018, RSA(DE_B),     false },  // NEO2_L3_LEFT_SINGLE_QUOTE  ‘
+  { 0x2019, RSA(DE_N),     false },  // NEO2_L3_RIGHT_SINGLE_QUOTE ’
+  { 0x2026, RALT(DE_DOT),  false },  // NEO2_L3_ELLIPSIS           …
+  { 0x005E, DE_CIRC,       true  },  // NEO2_L3_CIRCUMFLEX         ^
+  { 0x017F, RALT(DE_S),    false },  // NEO2_L3_SMALL_LONG_S       ſ
+  { 0x0060, DE_GRV,        true  },  // NEO2_L3_BACKTICK           `
+  { 0x00AA, RSA(DE_F),     false },  // NEO2_L3_FEMININE_ORDINAL   ª
+  { 0x00BA, RSA(DE_M),     false },  // NEO2_L3_MASCULINE_ORDINAL  º
+  { 0x2116, KC_NO,         false },  // NEO2_L3_NUMERO_SIGN        №
+  { 0x00B7, RALT(DE_COMM), false },  // NEO2_L3_MIDDLE_DOT         ·
+  { 0x00A3, RSA(DE_3),     false },  // NEO2_L3_BRITISH_POUND      £
+  { 0x00A4, RSA(DE_4),     false },  // NEO2_L3_CURRENCY_SIGN      ¤
+  { 0x00A1, RSA(DE_1),     false },  // NEO2_L3_INV_EXCLAMATION    ¡
+  { 0x00BF, RSA(DE_SS),    false },  // NEO2_L3_INV_QUESTIONMARK   ¿
+  { 0x2014, RSA(DE_MINS),  false },  // NEO2_L3_EM_DASH            —
+};
+
+_Static_assert(sizeof(unicode_symbols) / sizeof(unicode_symbols[0]) == NEO2_L3_EM_DASH - NEO2_L3_RSAQUO + 1,
+               "unicode_symbols[] needs an entry for every key from NEO2_L3_RSAQUO to NEO2_L3_EM_DASH");
+
+// Codepoints of the NEO_5 (Greek) and NEO_6 (math) keys. These have no
+// QWERTZ equivalent and are always sent through the Unicode input method.
+// Indexed by keycode - NEO2_L5_SUBSCRIPT_1.
+static const uint16_t PROGMEM layer_symbols[] = {
+  0x2081,  // NEO2_L5_SUBSCRIPT_1             ₁
+  0x2082,  // NEO2_L5_SUBSCRIPT_2             ₂
+  0x2083,  // NEO2_L5_SUBSCRIPT_3             ₃
+  0x2640,  // NEO2_L5_FEMALE                  ♀
+  0x2642,  // NEO2_L5_MALE                    ♂
+  0x26A5,  // NEO2_L5_MALE_FEMALE             ⚥
+  0x03F0,  // NEO2_L5_KAPPA_SYMBOL            ϰ
+  0x27E8,  // NEO2_L5_LANGLE                  ⟨
+  0x27E9,  // NEO2_L5_RANGLE                  ⟩
+  0x2080,  // NEO2_L5_SUBSCRIPT_0             ₀
+  0x2011,  // NEO2_L5_NB_HYPHEN               ‑
+  0x03BE,  // NEO2_L5_XI                      ξ
+  0x03BB,  // NEO2_L5_LAMBDA                  λ
+  0x03C7,  // NEO2_L5_CHI                     χ
+  0x03C9,  // NEO2_L5_OMEGA                   ω
+  0x03BA,  // NEO2_L5_KAPPA                   κ
+  0x03C8,  // NEO2_L5_PSI                     ψ
+  0x03B3,  // NEO2_L5_GAMMA                   γ
+  0x03C6,  // NEO2_L5_PHI                     φ
+  0x03D5,  // NEO2_L5_PHI_SYMBOL              ϕ
+  0x03C2,  // NEO2_L5_FINAL_SIGMA             ς
+  0x03B9,  // NEO2_L5_IOTA                    ι
+  0x03B1,  // NEO2_L5_ALPHA                   α
+  0x03B5,  // NEO2_L5_EPSILON                 ε
+  0x03BF,  // NEO2_L5_OMICRON                 ο
+  0x03C3,  // NEO2_L5_SIGMA                   σ
+  0x03BD,  // NEO2_L5_NU                      ν
+  0x03C1,  // NEO2_L5_RHO                     ρ
+  0x03C4,  // NEO2_L5_TAU                     τ
+  0x03B4,  // NEO2_L5_DELTA                   δ
+  0x03C5,  // NEO2_L5_UPSILON                 υ
+  0x03F5,  // NEO2_L5_LUNATE_EPSILON          ϵ
+  0x03B7,  // NEO2_L5_ETA                     η
+  0x03C0,  // NEO2_L5_PI                      π
+  0x03B6,  // NEO2_L5_ZETA                    ζ
+  0x03B2,  // NEO2_L5_BETA                    β
+  0x03BC,  // NEO2_L5_MU                      μ
+  0x03F1,  // NEO2_L5_RHO_SYMBOL              ϱ
+  0x03D1,  // NEO2_L5_THETA_SYMBOL            ϑ
+  0x03B8,  // NEO2_L5_THETA                   θ
+  0x00AC,  // NEO2_L6_NOT                     ¬
+  0x2228,  // NEO2_L6_OR                      ∨
+  0x2227,  // NEO2_L6_AND                     ∧
+  0x22A5,  // NEO2_L6_UP_TACK                 ⊥
+  0x2221,  // NEO2_L6_ANGLE                   ∡
+  0x2225,  // NEO2_L6_PARALLEL                ∥
+  0x2192,  // NEO2_L6_RIGHT_ARROW             →
+  0x221E,  // NEO2_L6_INFINITY                ∞
+  0x221D,  // NEO2_L6_PROPORTIONAL            ∝
+  0x2205,  // NEO2_L6_EMPTY_SET               ∅
+  0x254C,  // NEO2_L6_DASHED_LINE             ╌
+  0x039E,  // NEO2_L6_CAPITAL_XI              Ξ
+  0x221A,  // NEO2_L6_SQUARE_ROOT             √
+  0x039B,  // NEO2_L6_CAPITAL_LAMBDA          Λ
+  0x2102,  // NEO2_L6_COMPLEX                 ℂ
+  0x03A9,  // NEO2_L6_CAPITAL_OMEGA           Ω
+  0x00D7,  // NEO2_L6_TIMES                   ×
+  0x03A8,  // NEO2_L6_CAPITAL_PSI             Ψ
+  0x0393,  // NEO2_L6_CAPITAL_GAMMA           Γ
+  0x03A6,  // NEO2_L6_CAPITAL_PHI             Φ
+  0x211A,  // NEO2_L6_RATIONAL                ℚ
+  0x2218,  // NEO2_L6_RING                    ∘
+  0x2282,  // NEO2_L6_SUBSET                  ⊂
+  0x222B,  // NEO2_L6_INTEGRAL                ∫
+  0x2200,  // NEO2_L6_FOR_ALL                 ∀
+  0x2203,  // NEO2_L6_EXISTS                  ∃
+  0x2208,  // NEO2_L6_ELEMENT_OF              ∈
+  0x03A3,  // NEO2_L6_CAPITAL_SIGMA           Σ
+  0x2115,  // NEO2_L6_NATURAL                 ℕ
+  0x211D,  // NEO2_L6_REAL                    ℝ
+  0x2202,  // NEO2_L6_PARTIAL                 ∂
+  0x0394,  // NEO2_L6_CAPITAL_DELTA           Δ
+  0x2207,  // NEO2_L6_NABLA                   ∇
+  0x222A,  // NEO2_L6_UNION                   ∪
+  0x2229,  // NEO2_L6_INTERSECTION            ∩
+  0x2135,  // NEO2_L6_ALEF                    ℵ
+  0x03A0,  // NEO2_L6_CAPITAL_PI              Π
+  0x2124,  // NEO2_L6_INTEGERS                ℤ
+  0x21D0,  // NEO2_L6_LEFT_DOUBLE_ARROW       ⇐
+  0x21D4,  // NEO2_L6_LEFT_RIGHT_DOUBLE_ARROW ⇔
+  0x21D2,  // NEO2_L6_RIGHT_DOUBLE_ARROW      ⇒
+  0x21A6,  // NEO2_L6_MAPS_TO                 ↦
+  0x0398,  // NEO2_L6_CAPITAL_THETA           Θ
+};
+
+_Static_assert(sizeof(layer_symbols) / sizeof(layer_symbols[0]) == NEO2_L6_CAPITAL_THETA - NEO2_L5_SUBSCRIPT_1 + 1,
+               "layer_symbols[] needs an entry for every key from NEO2_L5_SUBSCRIPT_1 to NEO2_L6_CAPITAL_THETA");
+
+// Send a NEO2_L3_* symbol with the active output engine. Symbols without a
+// QWERTZ emulation are always typed as Unicode.
+static void emit_unicode_symbol(uint16_t keycode) {
+  const unicode_symbol_t *symbol = &unicode_symbols[keycode - NEO2_L3_RSAQUO];
+
+  if (neo2.unicode_output || pgm_read_word(&symbol->legacy) == KC_NO) {
+    register_unicode(pgm_read_word(&symbol->codepoint));
+    return;
+  }
+
+  tap_code16(pgm_read_word(&symbol->legacy));
+  if (pgm_read_byte(&symbol->dead)) {
+    tap_code(KC_SPACE);
+  }
+}
+
 // Special remapping for keys with different keycodes/macros when used with shift modifiers.
 bool process_record_user_shifted(uint16_t keycode, keyrecord_t *record) {
   uint8_t active_modifiers = get_mods();
-  uint8_t shifted = active_modifiers & MODS_SHIFT;
 
   // Early return on key release
   if(!record->event.pressed) {
     return true;
   }
 
-  if(shifted) {
-    clear_mods();
+  if (keycode >= NEO2_1 && keycode <= NEO2_SHARP_S) {
+    emit_shifted_emission(keycode, active_modifiers);
+    return false;
+  }
 
-    // The sent keys here are all based on US layout. I.e. look up how to
-    // produce the key you want using the german qwertz, then look in
-    // keymap_german what you need to send to get that.
-    switch(keycode) {
-      case NEO2_1:
-        // degree symbol
-        SEND_STRING(SS_LSFT("`"));
-        break;
-      case NEO2_2:
-        // section symbol
-        SEND_STRING(SS_LSFT("3"));
-        break;
-      case NEO2_3:
-        SEND_STRING(SS_RALT("1"));
-        break;
-      case NEO2_4:
-        // right angled quote
-        SEND_STRING(SS_RALT("z"));
-        break;
-      case NEO2_5:
-        // left angled quote
-        SEND_STRING(SS_RALT("x"));
-        break;
-      case NEO2_6:
-        // dollar sign
-        SEND_STRING(SS_LSFT("4"));
-        break;
-      case NEO2_7:
-        // euro sign
-        SEND_STRING(SS_RALT("e"));
-        break;
-      case NEO2_8:
-        // low9 double quote
-        SEND_STRING(SS_RALT("v"));
-        break;
-      case NEO2_9:
-        // left double quote
-        SEND_STRING(SS_RALT("b"));
-        break;
-      case NEO2_0:
-        // right double quote
-        SEND_STRING(SS_RALT("n"));
-        break;
-      case NEO2_MINUS:
-        // em dash
-        SEND_STRING(SS_LSFT(SS_RALT("/")));
-        break;
-      case NEO2_COMMA:
-        // en dash
-        SEND_STRING(SS_RALT("/"));
-        break;
-      case NEO2_DOT:
-        // bullet
-        SEND_STRING(SS_RALT(","));
-        break;
-      case NEO2_SHARP_S:
-        // ẞ
-        SEND_STRING(SS_LSFT(SS_RALT("s")));
-        break;
-      default:
-        set_mods(active_modifiers);
-        return true;
-    }
+  if (keycode >= NEO2_L3_RSAQUO && keycode <= NEO2_L3_EM_DASH) {
+    emit_unicode_symbol(keycode);
+    return false;
+  }
 
-    set_mods(active_modifiers);
+  if (keycode >= NEO2_L5_SUBSCRIPT_1 && keycode <= NEO2_L6_CAPITAL_THETA) {
+    register_unicode(pgm_read_word(&layer_symbols[keycode - NEO2_L5_SUBSCRIPT_1]));
     return false;
+  }
+
+  return true;
+}
+
+// Main block and keypad keycode of a NEO2_NUM_* key.
+typedef struct {
+  uint16_t keycode;
+  uint8_t  keypad;
+} numpad_key_t;
+
+// Indexed by keycode - NEO2_NUM_0. The keypad decimal key types a comma on
+// the german host layout.
+static const numpad_key_t PROGMEM numpad_keys[] = {
+  { KC_0,    KC_KP_0        },  // NEO2_NUM_0
+  { KC_1,    KC_KP_1        },  // NEO2_NUM_1
+  { KC_2,    KC_KP_2        },  // NEO2_NUM_2
+  { KC_3,    KC_KP_3        },  // NEO2_NUM_3
+  { KC_4,    KC_KP_4        },  // NEO2_NUM_4
+  { KC_5,    KC_KP_5        },  // NEO2_NUM_5
+  { KC_6,    KC_KP_6        },  // NEO2_NUM_6
+  { KC_7,    KC_KP_7        },  // NEO2_NUM_7
+  { KC_8,    KC_KP_8        },  // NEO2_NUM_8
+  { KC_9,    KC_KP_9        },  // NEO2_NUM_9
+  { DE_COMM, KC_KP_DOT      },  // NEO2_NUM_COMMA
+  { DE_SLSH, KC_KP_SLASH    },  // NEO2_NUM_SLASH
+  { DE_ASTR, KC_KP_ASTERISK },  // NEO2_NUM_ASTERISK
+  { DE_MINS, KC_KP_MINUS    },  // NEO2_NUM_MINUS
+  { DE_PLUS, KC_KP_PLUS     },  // NEO2_NUM_PLUS
+};
+
+_Static_assert(sizeof(numpad_keys) / sizeof(numpad_keys[0]) == NEO2_NUM_PLUS - NEO2_NUM_0 + 1,
+               "numpad_keys[] needs an entry for every key from NEO2_NUM_0 to NEO2_NUM_PLUS");
+_Static_assert(NEO2_NUM_PLUS - NEO2_NUM_0 < 16,
+               "neo2.numpad_keypad_held needs a bit for every key from NEO2_NUM_0 to NEO2_NUM_PLUS");
+
+// Press a NEO2_NUM_* key in the active numpad mode and release it as the
+// key it was pressed as. Keypad keys switch the host NumLock on first if it
+// is off, so every digit after that is a single report.
+static void process_numpad_key(uint16_t keycode, bool pressed) {
+  const numpad_key_t *key = &numpad_keys[keycode - NEO2_NUM_0];
+  uint16_t bit = 1 << (keycode - NEO2_NUM_0);
+
+  if (pressed ? !neo2.keypad_numpad : !(neo2.numpad_keypad_held & bit)) {
+    if (pressed) {
+      register_code16(pgm_read_word(&key->keycode));
+    } else {
+      unregister_code16(pgm_read_word(&key->keycode));
+    }
+    return;
+  }
+
+  if (pressed) {
+    if (!neo2.host_leds.num_lock) {
+      tap_code(KC_NUM_LOCK);
+      neo2.host_leds.num_lock = true;
+    }
+    neo2.numpad_keypad_held |= bit;
+    register_code(pgm_read_byte(&key->keypad));
   } else {
-    switch(keycode) {
-      case NEO2_1:
-        SEND_STRING(SS_TAP(X_1));
-        break;
-      case NEO2_2:
-        SEND_STRING(SS_TAP(X_2));
-        break;
-      case NEO2_3:
-        SEND_STRING(SS_TAP(X_3));
-        break;
-      case NEO2_4:
-        SEND_STRING(SS_TAP(X_4));
-        break;
-      case NEO2_5:
-        SEND_STRING(SS_TAP(X_5));
-        break;
-      case NEO2_6:
-        SEND_STRING(SS_TAP(X_6));
-        break;
-      case NEO2_7:
-        SEND_STRING(SS_TAP(X_7));
-        break;
-      case NEO2_8:
-        SEND_STRING(SS_TAP(X_8));
-        break;
-      case NEO2_9:
-        SEND_STRING(SS_TAP(X_9));
-        break;
-      case NEO2_0:
-        SEND_STRING(SS_TAP(X_0));
-        break;
-      case NEO2_MINUS:
-        SEND_STRING(SS_TAP(X_SLASH));
-        break;
-      case NEO2_COMMA:
-        SEND_STRING(SS_TAP(X_COMMA));
-        break;
-      case NEO2_DOT:
-        SEND_STRING(SS_TAP(X_DOT));
-        break;
-      case NEO2_SHARP_S:
-        // ß
-        SEND_STRING(SS_TAP(X_MINS));
-        break;
-      case NEO2_L3_CIRCUMFLEX:
-        SEND_STRING(SS_TAP(X_GRAVE) SS_TAP(X_SPACE));
-        break;
-      case NEO2_L3_BACKTICK:
-        SEND_STRING(SS_LSFT("=") SS_TAP(X_SPACE));
-        break;
-      case YELDIR_CTLTAB:
-        SEND_STRING(SS_LCTL("\t"));
-        break;
-      case YELDIR_CTLSTAB:
-        SEND_STRING(SS_LSFT(SS_LCTL("\t")));
-        break;
-      default:
-        return true;
+    neo2.numpad_keypad_held &= ~bit;
+    unregister_code(pgm_read_byte(&key->keypad));
+  }
+}
+
+// Host keycode of a NEO2_NAV_* key, indexed by keycode - NEO2_NAV_UP.
+static const uint8_t PROGMEM nav_keys[] = {
+  KC_UP,     // NEO2_NAV_UP
+  KC_DOWN,   // NEO2_NAV_DOWN
+  KC_LEFT,   // NEO2_NAV_LEFT
+  KC_RIGHT,  // NEO2_NAV_RIGHT
+  KC_PGUP,   // NEO2_NAV_PGUP
+  KC_PGDN,   // NEO2_NAV_PGDN
+};
+
+_Static_assert(sizeof(nav_keys) == NEO2_NAV_PGDN - NEO2_NAV_UP + 1,
+               "nav_keys[] needs an entry for every key from NEO2_NAV_UP to NEO2_NAV_PGDN");
+_Static_assert(NEO2_NAV_REPEAT_DELAY > NEO2_NAV_REPEAT_INTERVAL
+               && NEO2_NAV_REPEAT_INTERVAL >= NEO2_NAV_REPEAT_INTERVAL_MIN,
+               "NEO2_NAV_REPEAT_* must shrink from the delay to the minimum interval");
+
+// NEO2_NAV_* keys are tapped instead of held, the keyboard repeats them.
+// Held modifiers are left alone, so Shift or Ctrl plus a navigation key
+// never sends a modifier-only report. Releasing the repeated key hands the
+// repeat back to the previously pressed one that is still held.
+static void process_nav_key(uint16_t keycode, bool pressed) {
+  uint8_t index = keycode - NEO2_NAV_UP;
+
+  if (!pressed) {
+    for (uint8_t i = 0; i < neo2.nav_held_count; i++) {
+      if (neo2.nav_held[i] != index) {
+        continue;
+      }
+      neo2.nav_held_count--;
+      if (i == neo2.nav_held_count) {
+        neo2.nav_timer = timer_read();
+        neo2.nav_interval = NEO2_NAV_REPEAT_DELAY;
+      }
+      for (; i < neo2.nav_held_count; i++) {
+        neo2.nav_held[i] = neo2.nav_held[i + 1];
+      }
+      break;
     }
+    return;
+  }
 
-    return false;
+  tap_code(pgm_read_byte(&nav_keys[index]));
+  if (neo2.nav_held_count < sizeof(neo2.nav_held)) {
+    neo2.nav_held[neo2.nav_held_count++] = index;
   }
+  neo2.nav_timer = timer_read();
+  neo2.nav_interval = NEO2_NAV_REPEAT_DELAY;
 }
 
-// Runs for each key down or up event.
-bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+// Called every scan. After the initial delay the repeat interval shrinks by
+// NEO2_NAV_REPEAT_ACCEL per repeat down to NEO2_NAV_REPEAT_INTERVAL_MIN.
+static void nav_repeat(void) {
+  if (!neo2.nav_held_count || timer_elapsed(neo2.nav_timer) < neo2.nav_interval) {
+    return;
+  }
+
+  tap_code(pgm_read_byte(&nav_keys[neo2.nav_held[neo2.nav_held_count - 1]]));
+  neo2.nav_timer = timer_read();
+  if (neo2.nav_interval > NEO2_NAV_REPEAT_INTERVAL) {
+    neo2.nav_interval = NEO2_NAV_REPEAT_INTERVAL;
+  } else if (neo2.nav_interval >= NEO2_NAV_REPEAT_INTERVAL_MIN + NEO2_NAV_REPEAT_ACCEL) {
+    neo2.nav_interval -= NEO2_NAV_REPEAT_ACCEL;
+  } else {
+    neo2.nav_interval = NEO2_NAV_REPEAT_INTERVAL_MIN;
+  }
+}
+
+// Keys that can hold a layer, one bit each.
+enum layer_hold_sources {
+  HOLD_LMOD3 = (1 << 0),
+  HOLD_RMOD3 = (1 << 1),
+  HOLD_LMOD4 = (1 << 2),
+  HOLD_RMOD4 = (1 << 3),
+  HOLD_COMBO = (1 << 6),
+  HOLD_LOCK  = (1 << 7),
+};
+
+static void layer_hold_press(uint8_t layer, uint8_t source) {
+  if (neo2.layer_holds[layer] == 0) {
+    layer_on(layer);
+  }
+  neo2.layer_holds[layer] |= source;
+}
+
+static void layer_hold_release(uint8_t layer, uint8_t source) {
+  if (neo2.layer_holds[layer] == source) {
+    layer_off(layer);
+  }
+  neo2.layer_holds[layer] &= ~source;
+}
+
+static void layer_hold_combo(uint8_t layer, bool held) {
+  if (held == ((neo2.layer_holds[layer] & HOLD_COMBO) != 0)) {
+    return;
+  }
+
+  if (held) {
+    layer_hold_press(layer, HOLD_COMBO);
+  } else {
+    layer_hold_release(layer, HOLD_COMBO);
+  }
+}
+
+// Layers reached by combining holds: Shift+Mod3 gives NEO_5, Mod3+Mod4 NEO_6.
+static void layer_hold_update_combos(void) {
+  layer_hold_combo(NEO_5, neo2.layer_holds[NEO_3] && neo2.capslock_state);
+  layer_hold_combo(NEO_6, neo2.layer_holds[NEO_3] && neo2.layer_holds[NEO_4]);
+}
+
+// Press or release a layer hold of source.
+static void layer_hold(uint8_t layer, uint8_t source, bool pressed) {
+  if (pressed) {
+    layer_hold_press(layer, source);
+  } else if (neo2.layer_holds[layer] & source) {
+    layer_hold_release(layer, source);
+  } else {
+    return;
+  }
+
+  layer_hold_update_combos();
+}
+
+// Mod4 pressed while the other Mod4 key is held toggles the NEO_4 lock,
+// which keeps the layer on after both keys are released.
+static void layer_hold_mod4(uint8_t source, bool pressed) {
+  if (pressed && (neo2.layer_holds[NEO_4] & (HOLD_LMOD4 | HOLD_RMOD4) & ~source)) {
+    neo2.layer_holds[NEO_4] ^= HOLD_LOCK;
+  }
+  layer_hold(NEO_4, source, pressed);
+}
+
+// Node of the compose trie. The children of a node are stored next to each
+// other, the root nodes come first.
+typedef struct {
+  uint16_t input;     // keycode selecting this node
+  uint16_t value;     // leaf: codepoint, inner node: index of the first child
+  uint8_t  children;  // number of children, 0 for a leaf
+} compose_node_t;
+
+#define COMPOSE_ROOTS 13
+
+static const compose_node_t PROGMEM compose_trie[] = {
+  /*  0 */ { DE_A,     13,     2 },
+  /*  1 */ { DE_O,     15,     4 },
+  /*  2 */ { DE_T,     19,     1 },
+  /*  3 */ { DE_M,     20,     1 },
+  /*  4 */ { DE_X,     21,     1 },
+  /*  5 */ { DE_P,     22,     1 },
+  /*  6 */ { NEO2_1,   23,     2 },
+  /*  7 */ { NEO2_3,   25,     1 },
+  /*  8 */ { DE_EQL,   26,     1 },
+  /*  9 */ { DE_LABK,  27,     2 },
+  /* 10 */ { DE_RABK,  29,     1 },
+  /* 11 */ { DE_MINS,  30,     2 },
+  /* 12 */ { DE_PLUS,  34,     1 },
+  /* 13 */ { DE_A,     0x00E5, 0 },  // a a   å
+  /* 14 */ { DE_E,     0x00E6, 0 },  // a e   æ
+  /* 15 */ { DE_C,     0x00A9, 0 },  // o c   ©
+  /* 16 */ { DE_E,     0x0153, 0 },  // o e   œ
+  /* 17 */ { DE_O,     0x00B0, 0 },  // o o   °
+  /* 18 */ { DE_R,     0x00AE, 0 },  // o r   ®
+  /* 19 */ { DE_M,     0x2122, 0 },  // t m   ™
+  /* 20 */ { DE_U,     0x00B5, 0 },  // m u   µ
+  /* 21 */ { DE_X,     0x00D7, 0 },  // x x   ×
+  /* 22 */ { DE_P,     0x00B6, 0 },  // p p   ¶
+  /* 23 */ { NEO2_2,   0x00BD, 0 },  // 1 2   ½
+  /* 24 */ { NEO2_4,   0x00BC, 0 },  // 1 4   ¼
+  /* 25 */ { NEO2_4,   0x00BE, 0 },  // 3 4   ¾
+  /* 26 */ { DE_SLSH,  0x2260, 0 },  // = /   ≠
+  /* 27 */ { DE_MINS,  0x2190, 0 },  // < -   ←
+  /* 28 */ { DE_EQL,   0x2264, 0 },  // < =   ≤
+  /* 29 */ { DE_EQL,   0x2265, 0 },  // > =   ≥
+  /* 30 */ { DE_MINS,  32,     2 },
+  /* 31 */ { DE_RABK,  0x2192, 0 },  // - >   →
+  /* 32 */ { DE_MINS,  0x2014, 0 },  // - - - —
+  /* 33 */ { NEO2_DOT, 0x2013, 0 },  // - - . –
+  /* 34 */ { DE_MINS,  0x00B1, 0 },  // + -   ±
+};
+
+_Static_assert(sizeof(compose_trie) <= NEO2_COMPOSE_FLASH_BUDGET,
+               "compose_trie[] exceeds NEO2_COMPOSE_FLASH_BUDGET");
+
+// Advance the compose sequence by one key press. Completed sequences type
+// their codepoint, keys that don't continue a sequence abort it. The key
+// is consumed either way.
+static void process_compose(uint16_t keycode) {
+  // The NEO_1 minus types the same character as the NEO_3 one.
+  if (keycode == NEO2_MINUS) {
+    keycode = DE_MINS;
+  }
+
+  for (uint8_t i = neo2.compose_first; i < neo2.compose_first + neo2.compose_count; i++) {
+    const compose_node_t *node = &compose_trie[i];
+    if (pgm_read_word(&node->input) != keycode) {
+      continue;
+    }
+
+    uint8_t children = pgm_read_byte(&node->children);
+    if (children == 0) {
+      register_unicode(pgm_read_word(&node->value));
+      neo2.compose_count = 0;
+    } else {
+      neo2.compose_first = pgm_read_word(&node->value);
+      neo2.compose_count = children;
+    }
+    return;
+  }
+
+  neo2.compose_count = 0;
+}
+
+// Modifiers, layer keys and dual-role keys don't take part in compose
+// sequences.
+static bool is_compose_input(uint16_t keycode) {
+  return !IS_MOD(keycode)
+      && !(keycode >= NEO2_RMOD3 && keycode <= NEO2_RMOD4)
+      && !(keycode >= QK_LAYER_TAP && keycode <= QK_LAYER_TAP_MAX)
+      && !(keycode >= QK_TO && keycode <= QK_TO_MAX)
+      && !(keycode >= QK_MOMENTARY && keycode <= QK_MOMENTARY_MAX)
+      && !(keycode >= QK_MOD_TAP && keycode <= QK_MOD_TAP_MAX)
+      && keycode != NEO2_COMPOSE;
+}
+
+// Settings that survive a replug, stored in the user word of the EEPROM.
+typedef union {
+  uint32_t raw;
+  struct {
+    bool de_normal      :1;
+    bool unicode_output :1;
+    bool keypad_numpad  :1;
+  };
+} user_config_t;
+
+// Schedule a settings write. Changes are coalesced until none happened for
+// NEO2_SETTINGS_WRITE_DELAY ms, so flipping modes back and forth costs at
+// most one write.
+static void settings_changed(void) {
+  neo2.settings_dirty = true;
+  neo2.settings_timer = timer_read();
+}
+
+static void settings_flush(void) {
+  if (!neo2.settings_dirty || timer_elapsed(neo2.settings_timer) < NEO2_SETTINGS_WRITE_DELAY) {
+    return;
+  }
+
+  user_config_t config = { .raw = 0 };
+  config.de_normal = neo2.de_normal_mode;
+  config.unicode_output = neo2.unicode_output;
+  config.keypad_numpad = neo2.keypad_numpad;
+
+  // Only writes bytes that differ from what is stored.
+  eeconfig_update_user(config.raw);
+  neo2.settings_dirty = false;
+}
+
+// Keys down in the debounced matrix. Unlike a count kept from key events
+// this can't drift when the dynamic macro code swallows a press or a
+// release.
+static uint8_t matrix_keys_down(void) {
+  uint8_t keys = 0;
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    keys += __builtin_popcount(matrix_get_row(row));
+  }
+  return keys;
+}
+
+// With all keys up nothing may hold a layer, a modifier or a key: only the
+// base layer of the mode and a locked NEO_4 may be on, no key may be in the
+// report and no navigation key may repeat. Anything else is stuck and reset
+// here, so a bug in the hold tracker costs a log line instead of a replug.
+// matrix_scan_user runs before the core handles the events of a scan, so
+// the check waits one scan for the last release to be processed.
+static void check_idle_state(void) {
+  bool keys_down = matrix_keys_down();
+  bool check = neo2.idle_check_pending && !keys_down;
+
+  neo2.idle_check_pending = neo2.keys_were_down && !keys_down;
+  neo2.keys_were_down = keys_down;
+  if (!check) {
+    return;
+  }
+
+  bool locked = neo2.layer_holds[NEO_4] & HOLD_LOCK;
+  layer_state_t expected = 0;
+  if (neo2.de_normal_mode) {
+    expected |= (layer_state_t)1 << DE_NORMAL;
+  }
+  if (locked) {
+    expected |= (layer_state_t)1 << NEO_4;
+  }
+
+  // The NEO_1 bit is set or not depending on how NEO_1 was reached.
+  layer_state_t layers = layer_state & ~((layer_state_t)1 << NEO_1);
+  if (layers == expected && !get_mods() && !has_anykey() && !neo2.capslock_state
+      && !neo2.nav_held_count && !neo2.numpad_keypad_held) {
+    return;
+  }
+
+  uprintf("GUARD: layers: 0x%02X, mods: 0x%02X, keys: %u, caps: 0x%02X, nav: %u, numpad: 0x%04X\n",
+          layer_state, get_mods(), has_anykey(), neo2.capslock_state,
+          neo2.nav_held_count, neo2.numpad_keypad_held);
+
+  for (uint8_t layer = 0; layer < sizeof(neo2.layer_holds); layer++) {
+    neo2.layer_holds[layer] = 0;
+  }
+  if (locked) {
+    neo2.layer_holds[NEO_4] = HOLD_LOCK;
+  }
+  neo2.capslock_state = 0;
+  neo2.nav_held_count = 0;
+  neo2.numpad_keypad_held = 0;
+  clear_keyboard();
+  layer_state_set(expected);
+}
+
+// Layer, modifier and caps lock handling in front of the shifted remapping.
+bool process_record_user_neo2(uint16_t keycode, keyrecord_t *record) {
+  // Gaming fast path: DE_NORMAL is plain QWERTZ without any Neo remapping.
+  // It follows the mode rather than the top layer, so a key pressed with
+  // FKEYS on top goes the same way as its release. Only the keymap's own
+  // keycodes on FKEYS still need the Neo path.
+  if (neo2.de_normal_mode && keycode < SAFE_RANGE) {
+    return true;
+  }
+
+  if (record->event.pressed && keycode != NEO2_LMOD3) {
+    neo2.lmod3_interrupted = true;
+  }
+
+  if (neo2.compose_count && record->event.pressed && is_compose_input(keycode)) {
+    process_compose(keycode);
+    return false;
+  }
+
   switch(keycode) {
     case KC_LSFT:
+    case KC_RSFT:
       if (record->event.pressed) {
-        capslock_state |= (MOD_BIT(KC_LSFT));
+        uint8_t previous_state = neo2.capslock_state;
+        neo2.capslock_state |= MOD_BIT(keycode);
+
+        // Toggle CAPSLOCK once, when the second shift key completes the combo.
+        if (neo2.capslock_state == MODS_SHIFT && previous_state != MODS_SHIFT) {
+          if (neo2.host_leds.caps_lock) {
+            unregister_code(KC_LOCKING_CAPS_LOCK);
+          } else {
+            register_code(KC_LOCKING_CAPS_LOCK);
+          }
+        }
       } else {
-        capslock_state &= ~(MOD_BIT(KC_LSFT));
+        neo2.capslock_state &= ~MOD_BIT(keycode);
       }
+      layer_hold_update_combos();
       break;
-    case KC_RSFT:
-      if (record->event.pressed) {
-        capslock_state |= MOD_BIT(KC_RSFT);
-      } else {
-        capslock_state &= ~(MOD_BIT(KC_RSFT));
+    case NEO2_LMOD3:
+      // A tap falls through to the Escape of the layer-tap keycode.
+      if (record->tap.count == 0) {
+        if (record->event.pressed) {
+          neo2.lmod3_interrupted = false;
+        } else if (!neo2.lmod3_interrupted && neo2.layer_holds[NEO_3] == HOLD_LMOD3) {
+          // Retro tap: held past the tapping term without using the layer.
+          tap_code(KC_ESC);
+        }
+        layer_hold(NEO_3, HOLD_LMOD3, record->event.pressed);
+        return false;
       }
       break;
-    case YELDIR_AC:
+    case NEO2_RMOD3:
+      layer_hold(NEO_3, HOLD_RMOD3, record->event.pressed);
+      break;
+    case NEO2_LMOD4:
+      layer_hold_mod4(HOLD_LMOD4, record->event.pressed);
+      break;
+    case NEO2_RMOD4:
+      layer_hold_mod4(HOLD_RMOD4, record->event.pressed);
+      break;
+    case NEO2_NUM_0 ... NEO2_NUM_PLUS:
+      process_numpad_key(keycode, record->event.pressed);
+      return false;
+    case NEO2_NAV_UP ... NEO2_NAV_PGDN:
+      process_nav_key(keycode, record->event.pressed);
+      return false;
+    case NEO2_COMPOSE:
       if (record->event.pressed) {
-        register_code(KC_LALT);
-        register_code(KC_LCTL);
-      } else {
-        unregister_code(KC_LALT);
-        unregister_code(KC_LCTL);
+        neo2.compose_first = 0;
+        neo2.compose_count = COMPOSE_ROOTS;
       }
-      break;
-    case NEO2_LMOD3:
+      return false;
+    case NEO2_NUMPAD_TOGGLE:
       if (record->event.pressed) {
-        layer_on(NEO_3);
-        neo3_state |= (1 << 1);
-      } else {
-        // Turn off NEO_3 layer unless it's enabled through NEO2_RMOD3 as well.
-        if ((neo3_state & ~(1 << 1)) == 0) {
-          layer_off(NEO_3);
-        }
-        neo3_state &= ~(1 << 1);
+        neo2.keypad_numpad = !neo2.keypad_numpad;
+        settings_changed();
       }
-      break;
+      return false;
+    case NEO2_UNICODE_TOGGLE:
+      if (record->event.pressed) {
+        neo2.unicode_output = !neo2.unicode_output;
+        settings_changed();
+      }
+      return false;
+    case NEO2_DUMP_STATS:
+      if (record->event.pressed) {
+        dump_stats();
+      }
+      return false;
   }
 
-  if ((capslock_state & MODS_SHIFT) == MODS_SHIFT) {
-    // CAPSLOCK is currently active, disable it
-    if (host_keyboard_led_state().caps_lock) {
-      unregister_code(KC_LOCKING_CAPS_LOCK);
-    } else {
-      register_code(KC_LOCKING_CAPS_LOCK);
+  PROFILE_START();
+  bool result = process_record_user_shifted(keycode, record);
+  PROFILE_STOP(PROFILE_SLOT_SHIFTED);
+  return result;
+}
+
+#ifdef DYNAMIC_MACRO_ENABLE
+// Playback clears the layers, replays the macro with the keys of the
+// keyboard still held and restores the layers afterwards. The keymap's own
+// tracking of held keys doesn't survive that: layer_state_set_user() forgets
+// the holds and the NEO_4 lock of the cleared layers, keys pressed but not
+// released within the macro stay tracked as held, and keys held during the
+// playback get released on the layer they were pressed on within the macro.
+// Put all of it back as it was before the playback.
+static bool process_dynamic_macro_neo2(uint16_t keycode, keyrecord_t *record) {
+  if ((keycode != DM_PLY1 && keycode != DM_PLY2) || record->event.pressed) {
+    return process_dynamic_macro(keycode, record);
+  }
+
+  uint8_t layer_holds[sizeof(neo2.layer_holds)];
+  for (uint8_t layer = 0; layer < sizeof(layer_holds); layer++) {
+    layer_holds[layer] = neo2.layer_holds[layer];
+  }
+  uint8_t nav_held[sizeof(neo2.nav_held)];
+  for (uint8_t i = 0; i < sizeof(nav_held); i++) {
+    nav_held[i] = neo2.nav_held[i];
+  }
+  uint8_t nav_held_count = neo2.nav_held_count;
+  uint16_t numpad_keypad_held = neo2.numpad_keypad_held;
+  uint8_t capslock_state = neo2.capslock_state;
+  bool lmod3_interrupted = neo2.lmod3_interrupted;
+  uint8_t source_layers[MATRIX_ROWS][MATRIX_COLS];
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      source_layers[row][col] = read_source_layers_cache((keypos_t){ .row = row, .col = col });
     }
+  }
+
+  bool result = process_dynamic_macro(keycode, record);
+
+  for (uint8_t layer = 0; layer < sizeof(layer_holds); layer++) {
+    neo2.layer_holds[layer] = layer_holds[layer];
+  }
+  for (uint8_t i = 0; i < sizeof(nav_held); i++) {
+    neo2.nav_held[i] = nav_held[i];
+  }
+  neo2.nav_held_count = nav_held_count;
+  neo2.numpad_keypad_held = numpad_keypad_held;
+  neo2.capslock_state = capslock_state;
+  neo2.lmod3_interrupted = lmod3_interrupted;
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      update_source_layers_cache((keypos_t){ .row = row, .col = col }, source_layers[row][col]);
+    }
+  }
+  return result;
+}
+#endif
+
+// Runs for each key down or up event.
+bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+  neo2.key_events++;
+
+#ifdef NEO2_TRACE
+  // Key event trace, one line per event. Capture it with `qmk console` to
+  // replay or diff a typing session without reflashing.
+  uprintf("KL: kc: 0x%04X, col: %2u, row: %2u, pressed: %u, time: %5u\n",
+          keycode, record->event.key.col, record->event.key.row,
+          record->event.pressed, record->event.time);
+#endif
+#ifdef NEO2_HEATMAP
+  if (record->event.pressed) {
+    heatmap_record_press(record->event.key);
+  }
+#endif
+
+#ifdef DYNAMIC_MACRO_ENABLE
+  // Called here instead of by the core (DYNAMIC_MACRO_USER_CALL).
+  if (!process_dynamic_macro_neo2(keycode, record)) {
     return false;
   }
+#endif
 
-  return process_record_user_shifted(keycode, record);
+  PROFILE_START();
+  bool result = process_record_user_neo2(keycode, record);
+  PROFILE_STOP_EVENT(profile_slot_for(keycode));
+  return result;
 };
 
 
+// Tapping term of the dual-role keys.
+uint16_t get_tapping_term(uint16_t keycode, keyrecord_t *record) {
+  switch (keycode) {
+    case NEO2_LMOD3:
+      return NEO2_LMOD3_TAPPING_TERM;
+    case YELDIR_AC:
+      return YELDIR_AC_TAPPING_TERM;
+    default:
+      return TAPPING_TERM;
+  }
+}
+
+// Mod3 turns into a hold as soon as another key is pressed.
+bool get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record) {
+  return keycode == NEO2_LMOD3;
+}
+
+// Ctrl+Alt turns into a hold when another key is tapped while it is down.
+bool get_permissive_hold(uint16_t keycode, keyrecord_t *record) {
+  return keycode == YELDIR_AC;
+}
+
+// Ctrl+Alt held without using it still sends Tab on release. Mod3 does its
+// own retro tap in process_record_user_neo2.
+bool get_retro_tapping(uint16_t keycode, keyrecord_t *record) {
+  return keycode == YELDIR_AC;
+}
+
+
 // Runs just one time when the keyboard initializes.
 void matrix_init_user(void) {
+  ergodox_board_led_off();
+  ergodox_right_led_1_off();
+  ergodox_right_led_2_off();
+  ergodox_right_led_3_off();
 
+#if defined(NEO2_PROFILE) && defined(__arm__)
+  // Enable the DWT cycle counter used by the PROFILE_* macros.
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
 };
 
 
 // Runs constantly in the background, in a loop.
 void matrix_scan_user(void) {
-    uint8_t layer = biton32(layer_state);
-
-    ergodox_board_led_off();
-    ergodox_right_led_1_off();
-    ergodox_right_led_2_off();
-    ergodox_right_led_3_off();
-    switch (layer) {
-      // TODO: Make this relevant to the ErgoDox EZ.
-        case NEO_3:
-            ergodox_right_led_1_on();
-            break;
-        case NEO_4:
-            ergodox_right_led_2_on();
-            break;
-        case DE_NORMAL:
-            ergodox_right_led_3_on();
-            break;
-        default:
-            // none
-            break;
+    PROFILE_START();
+    settings_flush();
+    nav_repeat();
+    check_idle_state();
+    PROFILE_STOP(PROFILE_SLOT_SCAN);
+};
+
+
+// Runs once after the keyboard is initialized.
+void keyboard_post_init_user(void) {
+  user_config_t config = { .raw = eeconfig_read_user() };
+
+  neo2.unicode_output = config.unicode_output;
+  neo2.keypad_numpad = config.keypad_numpad;
+  if (config.de_normal) {
+    layer_move(DE_NORMAL);
+  }
+}
+
+
+// Runs when the EEPROM is reset.
+void eeconfig_init_user(void) {
+  user_config_t config = { .raw = 0 };
+  eeconfig_update_user(config.raw);
+}
+
+
+static void indicator_led_set(uint8_t led, bool on) {
+  switch (led) {
+    case 1:
+      if (on) ergodox_right_led_1_on(); else ergodox_right_led_1_off();
+      break;
+    case 2:
+      if (on) ergodox_right_led_2_on(); else ergodox_right_led_2_off();
+      break;
+    case 3:
+      if (on) ergodox_right_led_3_on(); else ergodox_right_led_3_off();
+      break;
+  }
+}
+
+// Runs on every layer change. The LEDs are only written when the indicated
+// layers actually change.
+layer_state_t layer_state_set_user(layer_state_t state) {
+  // layer_on() of an active layer, e.g. from the hold tracker, ends up here too.
+  if (state == neo2.last_layer_state) {
+    return state;
+  }
+  neo2.last_layer_state = state;
+
+  uint8_t layer = get_highest_layer(state);
+  uint8_t leds;
+
+  // Forget the holds of layers switched off elsewhere, e.g. a TO() while
+  // NEO_4 is locked.
+  for (uint8_t held = 0; held < sizeof(neo2.layer_holds); held++) {
+    if (!(state & ((layer_state_t)1 << held))) {
+      neo2.layer_holds[held] = 0;
+    }
+  }
+
+#ifdef NEO2_HEATMAP
+  if (layer != neo2.current_layer) {
+    heatmap_record_transition(neo2.current_layer, layer);
+  }
+#endif
+  neo2.current_layer = layer;
+
+  if (layer_state_cmp(state, DE_NORMAL) != neo2.de_normal_mode) {
+    neo2.de_normal_mode = !neo2.de_normal_mode;
+    settings_changed();
+    // Keys held across the switch are released through the other mode's
+    // path, which doesn't undo what this one did on their press. Release
+    // everything and drop the state those keys would have cleared.
+    neo2.nav_held_count = 0;
+    neo2.numpad_keypad_held = 0;
+    neo2.capslock_state = 0;
+    neo2.compose_count = 0;
+    clear_keyboard();
+#ifdef NKRO_ENABLE
+    // NKRO for gaming only, 6KRO keeps the Neo reports compatible with any host.
+    keymap_config.nkro = neo2.de_normal_mode;
+#endif
+  }
+
+  switch (layer) {
+    case NEO_3:
+      leds = 1 << 1;
+      break;
+    case NEO_4:
+      leds = 1 << 2;
+      break;
+    case DE_NORMAL:
+      leds = 1 << 3;
+      break;
+    default:
+      leds = 0;
+      break;
+  }
+
+  // A locked NEO_4 stays lit while Mod3 layers are on top of it.
+  if (neo2.layer_holds[NEO_4] & HOLD_LOCK) {
+    leds |= 1 << 2;
+  }
+
+  for (uint8_t led = 1; led <= 3; led++) {
+    if ((leds ^ neo2.indicator_leds) & (1 << led)) {
+      indicator_led_set(led, leds & (1 << led));
     }
+  }
+  neo2.indicator_leds = leds;
+
+  return state;
+}
+
+
+// Runs when the host changes its lock LEDs.
+bool led_update_user(led_t led_state) {
+  neo2.host_leds = led_state;
+  return true;
+}
+
+// Raw HID control channel. Every request is [command, payload...] in one
+// report; the reply echoes the command followed by a status byte and the
+// response payload, padded to the report size.
+#define NEO2_HID_PROTOCOL_VERSION 1
+
+enum neo2_hid_commands {
+  NEO2_HID_GET_VERSION  = 0x01,  // -> [version]
+  NEO2_HID_SET_MODE     = 0x02,  // [0: Neo, 1: DE_NORMAL]
+  NEO2_HID_SET_UNICODE  = 0x03,  // [0: legacy, 1: Unicode]
+  NEO2_HID_SET_NUMPAD   = 0x04,  // [0: main block, 1: keypad]
+  NEO2_HID_GET_COUNTERS = 0x05,  // -> [events (u32 LE), keys down, layer, flags]
+};
+
+enum neo2_hid_status {
+  NEO2_HID_OK          = 0x00,
+  NEO2_HID_UNKNOWN_CMD = 0x01,
+  NEO2_HID_BAD_ARG     = 0x02,
 };
+
+// Bits of the flags byte of NEO2_HID_GET_COUNTERS.
+#define NEO2_HID_FLAG_DE_NORMAL (1 << 0)
+#define NEO2_HID_FLAG_UNICODE   (1 << 1)
+#define NEO2_HID_FLAG_NUMPAD    (1 << 2)
+
+void raw_hid_receive(uint8_t *data, uint8_t length) {
+  uint8_t command = data[0];
+  uint8_t arg = data[1];
+  uint8_t *reply = &data[2];
+
+  for (uint8_t i = 1; i < length; i++) {
+    data[i] = 0;
+  }
+  data[1] = NEO2_HID_OK;
+
+  switch (command) {
+    case NEO2_HID_GET_VERSION:
+      reply[0] = NEO2_HID_PROTOCOL_VERSION;
+      break;
+    case NEO2_HID_SET_MODE:
+      if (arg > 1) {
+        data[1] = NEO2_HID_BAD_ARG;
+        break;
+      }
+      // Same as the TO() keys, layer_state_set_user saves the mode.
+      layer_move(arg ? DE_NORMAL : NEO_1);
+      break;
+    case NEO2_HID_SET_UNICODE:
+    case NEO2_HID_SET_NUMPAD:
+      if (arg > 1) {
+        data[1] = NEO2_HID_BAD_ARG;
+        break;
+      }
+      if (command == NEO2_HID_SET_UNICODE) {
+        neo2.unicode_output = arg;
+      } else {
+        neo2.keypad_numpad = arg;
+      }
+      settings_changed();
+      break;
+    case NEO2_HID_GET_COUNTERS:
+      reply[0] = neo2.key_events;
+      reply[1] = neo2.key_events >> 8;
+      reply[2] = neo2.key_events >> 16;
+      reply[3] = neo2.key_events >> 24;
+      reply[4] = matrix_keys_down();
+      reply[5] = neo2.current_layer;
+      reply[6] = (neo2.de_normal_mode ? NEO2_HID_FLAG_DE_NORMAL : 0)
+               | (neo2.unicode_output ? NEO2_HID_FLAG_UNICODE : 0)
+               | (neo2.keypad_numpad ? NEO2_HID_FLAG_NUMPAD : 0);
+      break;
+    default:
+      data[1] = NEO2_HID_UNKNOWN_CMD;
+      break;
+  }
+
+  raw_hid_send(data, length);
+}
+
+// Size budgets from config.h. Flash is checked per layer and per table,
+// RAM for the always-on state and the optional debug features.
+_Static_assert(sizeof(keymaps[0]) <= NEO2_BUDGET_LAYER_FLASH,
+               "a keymaps[] layer exceeds NEO2_BUDGET_LAYER_FLASH");
+_Static_assert(sizeof(keymaps) <= NEO2_BUDGET_KEYMAPS_FLASH,
+               "keymaps[] exceeds NEO2_BUDGET_KEYMAPS_FLASH");
+_Static_assert(sizeof(shifted_emissions) + sizeof(numpad_keys) + sizeof(nav_keys)
+               <= NEO2_BUDGET_KEY_TABLES_FLASH,
+               "shifted_emissions[], numpad_keys[] and nav_keys[] exceed NEO2_BUDGET_KEY_TABLES_FLASH");
+_Static_assert(sizeof(unicode_symbols) + sizeof(layer_symbols) <= NEO2_BUDGET_UNICODE_FLASH,
+               "unicode_symbols[] and layer_symbols[] exceed NEO2_BUDGET_UNICODE_FLASH");
+
+_Static_assert(sizeof(neo2) <= NEO2_BUDGET_STATE_RAM,
+               "keymap state exceeds NEO2_BUDGET_STATE_RAM");
+
+#ifdef NEO2_PROFILE
+_Static_assert(sizeof(profile_stats) + sizeof(profile_first_event) + sizeof(profile_last_event)
+               <= NEO2_BUDGET_PROFILE_RAM,
+               "NEO2_PROFILE state exceeds NEO2_BUDGET_PROFILE_RAM");
+#endif
+#ifdef NEO2_HEATMAP
+_Static_assert(sizeof(heatmap_presses) + sizeof(heatmap_transitions) + sizeof(heatmap_head)
+               + sizeof(heatmap_tail) + sizeof(heatmap_dropped)
+               <= NEO2_BUDGET_HEATMAP_RAM,
+               "NEO2_HEATMAP state exceeds NEO2_BUDGET_HEATMAP_RAM");
+#endif
@@ -0,0 +1,5 @@
+UNICODE_ENABLE = yes
+NKRO_ENABLE = yes
+DEBOUNCE_TYPE = sym_eager_pk
+DYNAMIC_MACRO_ENABLE = yes
+RAW_ENABLE = yes
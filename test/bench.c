@@ -0,0 +1,515 @@
+// Benchmarks of keymap.c on the host, run with `make -C test bench`. Every
+// corpus given on the command line is typed on the Neo layers as a `KL:`
+// trace with a simple timing model and replayed through the simulated core
+// with NEO2_PROFILE built in. `-t trace` replays a recorded trace instead.
+#include "../keymap.c"
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Keycodes typing the characters of the corpora. Each is looked up on
+// NEO_1, NEO_3 and NEO_4 in that order, capitals are typed with Shift.
+static const struct {
+  uint32_t codepoint;
+  uint16_t keycode;
+} characters[] = {
+  { 'a', DE_A }, { 'b', DE_B }, { 'c', DE_C }, { 'd', DE_D }, { 'e', DE_E }, { 'f', DE_F },
+  { 'g', DE_G }, { 'h', DE_H }, { 'i', DE_I }, { 'j', DE_J }, { 'k', DE_K }, { 'l', DE_L },
+  { 'm', DE_M }, { 'n', DE_N }, { 'o', DE_O }, { 'p', DE_P }, { 'q', DE_Q }, { 'r', DE_R },
+  { 's', DE_S }, { 't', DE_T }, { 'u', DE_U }, { 'v', DE_V }, { 'w', DE_W }, { 'x', DE_X },
+  { 'y', DE_Y }, { 'z', DE_Z }, { 0xE4, DE_ADIA }, { 0xF6, DE_ODIA }, { 0xFC, DE_UDIA },
+  { 0xDF, NEO2_SHARP_S },
+  { '1', NEO2_1 }, { '2', NEO2_2 }, { '3', NEO2_3 }, { '4', NEO2_4 }, { '5', NEO2_5 },
+  { '6', NEO2_6 }, { '7', NEO2_7 }, { '8', NEO2_8 }, { '9', NEO2_9 }, { '0', NEO2_0 },
+  { ' ', KC_SPACE }, { '\n', KC_ENTER }, { '\t', KC_TAB },
+  { ',', NEO2_COMMA }, { '.', NEO2_DOT }, { '-', NEO2_MINUS },
+  { '_', NEO2_L3_UNDERSCORE }, { '[', NEO2_L3_LBRACKET }, { ']', NEO2_L3_RBRACKET },
+  { '^', NEO2_L3_CIRCUMFLEX }, { '!', NEO2_L3_EXCLAMATION }, { '<', NEO2_L3_LESSTHAN },
+  { '>', NEO2_L3_GREATERTHAN }, { '=', NEO2_L3_EQUAL }, { '&', NEO2_L3_AMPERSAND },
+  { '\\', NEO2_L3_BSLASH }, { '/', NEO2_L3_SLASH }, { '{', NEO2_L3_CLBRACKET },
+  { '}', NEO2_L3_CRBRACKET }, { '*', NEO2_L3_ASTERISK }, { '?', NEO2_L3_QUESTIONMARK },
+  { '(', NEO2_L3_LPARENTHESES }, { ')', NEO2_L3_RPARENTHESES }, { ':', NEO2_L3_COLON },
+  { '@', NEO2_L3_AT }, { '#', NEO2_L3_HASH }, { '$', NEO2_L3_DOLLAR }, { '|', NEO2_L3_PIPE },
+  { '~', NEO2_L3_TILDE }, { '`', NEO2_L3_BACKTICK }, { '+', NEO2_L3_PLUS },
+  { '%', NEO2_L3_PERCENT }, { '"', NEO2_L3_DOUBLE_QUOTE }, { '\'', NEO2_L3_SINGLE_QUOTE },
+  { ';', NEO2_L3_SEMICOLON }, { 0x2026, NEO2_L3_ELLIPSIS }, { 0x2014, NEO2_L3_EM_DASH },
+};
+
+static const uint8_t typing_layers[] = { NEO_1, NEO_3, NEO_4 };
+
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint16_t keycode;
+  uint32_t time;
+  size_t   order;
+} trace_event_t;
+
+static struct {
+  trace_event_t *events;
+  size_t         count;
+  size_t         capacity;
+  uint32_t       free_at[MATRIX_ROWS][MATRIX_COLS];
+  uint32_t       random;
+  char          *text;
+  size_t         text_size;
+} trace;
+
+// xorshift32, so every run types with the same timing.
+static uint32_t random_between(uint32_t min, uint32_t max) {
+  trace.random ^= trace.random << 13;
+  trace.random ^= trace.random >> 17;
+  trace.random ^= trace.random << 5;
+  return min + trace.random % (max - min + 1);
+}
+
+// The LAYOUT_ergodox() macro fills the matrix with the 38 keys of the left
+// hand first.
+static bool left_hand(keypos_t key) {
+  return key.row * MATRIX_COLS + key.col < 38;
+}
+
+static bool find_key(uint16_t keycode, uint8_t *layer, keypos_t *key) {
+  for (size_t i = 0; i < sizeof(typing_layers); i++) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        if (keymaps[typing_layers[i]][row][col] == keycode) {
+          *layer = typing_layers[i];
+          *key = (keypos_t){ .col = col, .row = row };
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+static void trace_add(keypos_t key, uint16_t keycode, bool pressed, uint32_t time) {
+  if (trace.count == trace.capacity) {
+    trace.capacity = trace.capacity ? trace.capacity * 2 : 4096;
+    trace.events = realloc(trace.events, trace.capacity * sizeof(*trace.events));
+    if (!trace.events) {
+      abort();
+    }
+  }
+  trace.events[trace.count] = (trace_event_t){ key, pressed, keycode, time, trace.count };
+  trace.count++;
+}
+
+static int trace_event_cmp(const void *a, const void *b) {
+  const trace_event_t *x = a, *y = b;
+  if (x->time != y->time) {
+    return x->time < y->time ? -1 : 1;
+  }
+  return x->order < y->order ? -1 : 1;
+}
+
+static uint32_t decode_utf8(const unsigned char **text) {
+  const unsigned char *p = *text;
+  uint32_t codepoint = *p++;
+  int continuation = codepoint >= 0xF0 ? 3 : codepoint >= 0xE0 ? 2 : codepoint >= 0xC0 ? 1 : 0;
+  if (continuation) {
+    codepoint &= 0x3F >> continuation;
+  }
+  while (continuation-- && (*p & 0xC0) == 0x80) {
+    codepoint = (codepoint << 6) | (*p++ & 0x3F);
+  }
+  *text = p;
+  return codepoint;
+}
+
+static uint16_t keycode_of(uint32_t codepoint, bool *shift) {
+  *shift = false;
+  if ((codepoint >= 'A' && codepoint <= 'Z') || codepoint == 0xC4 || codepoint == 0xD6 || codepoint == 0xDC) {
+    codepoint += 0x20;
+    *shift = true;
+  }
+  for (size_t i = 0; i < sizeof(characters) / sizeof(characters[0]); i++) {
+    if (characters[i].codepoint == codepoint) {
+      return characters[i].keycode;
+    }
+  }
+  return KC_NO;
+}
+
+// Type text as key events. Modifiers are pressed on the other hand shortly
+// before the key and released after it, plain keys roll over into each
+// other. Returns the number of characters typed, the others are counted in
+// skipped.
+static size_t type_text(const char *text, size_t *skipped) {
+  uint32_t next = 1000;
+  size_t typed = 0;
+
+  memset(trace.free_at, 0, sizeof(trace.free_at));
+  trace.count = 0;
+  trace.random = 0x4E454F32;
+  *skipped = 0;
+
+  for (const unsigned char *p = (const unsigned char *)text; *p;) {
+    bool shift;
+    uint8_t layer;
+    keypos_t key;
+    uint16_t keycode = keycode_of(decode_utf8(&p), &shift);
+    if (keycode == KC_NO || !find_key(keycode, &layer, &key)) {
+      (*skipped)++;
+      continue;
+    }
+
+    uint16_t mod = layer == NEO_3 ? (left_hand(key) ? NEO2_RMOD3 : NEO2_LMOD3)
+                 : layer == NEO_4 ? (left_hand(key) ? NEO2_RMOD4 : NEO2_LMOD4)
+                 : shift          ? (left_hand(key) ? KC_RSFT : KC_LSFT)
+                 : KC_NO;
+    uint32_t start = next > trace.free_at[key.row][key.col] ? next : trace.free_at[key.row][key.col];
+    if (mod == KC_NO) {
+      uint32_t release = start + random_between(50, 110);
+      trace_add(key, keycode, true, start);
+      trace_add(key, keycode, false, release);
+      trace.free_at[key.row][key.col] = release + 20;
+      next = start + random_between(80, 170);
+    } else {
+      uint8_t mod_layer;
+      keypos_t mod_key;
+      find_key(mod, &mod_layer, &mod_key);
+      if (start < trace.free_at[mod_key.row][mod_key.col]) {
+        start = trace.free_at[mod_key.row][mod_key.col];
+      }
+      uint32_t press = start + random_between(25, 50);
+      uint32_t release = press + random_between(50, 100);
+      uint32_t mod_release = release + random_between(15, 40);
+      trace_add(mod_key, mod, true, start);
+      trace_add(key, keycode, true, press);
+      trace_add(key, keycode, false, release);
+      trace_add(mod_key, mod, false, mod_release);
+      trace.free_at[key.row][key.col] = release + 20;
+      trace.free_at[mod_key.row][mod_key.col] = mod_release + 20;
+      next = mod_release + random_between(30, 90);
+    }
+    typed++;
+  }
+
+  qsort(trace.events, trace.count, sizeof(*trace.events), trace_event_cmp);
+  return typed;
+}
+
+// Write the typed events in the format of NEO2_TRACE.
+static void trace_write(void) {
+  free(trace.text);
+  FILE *out = open_memstream(&trace.text, &trace.text_size);
+  for (size_t i = 0; i < trace.count; i++) {
+    const trace_event_t *event = &trace.events[i];
+    fprintf(out, "KL: kc: 0x%04X, col: %2u, row: %2u, pressed: %u, time: %5u\n", event->keycode,
+            event->key.col, event->key.row, event->pressed, (uint16_t)event->time);
+  }
+  fclose(out);
+}
+
+static char *read_file(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *text = malloc((size_t)size + 1);
+  if (text && fread(text, 1, (size_t)size, file) != (size_t)size) {
+    free(text);
+    text = NULL;
+  }
+  fclose(file);
+  if (text) {
+    text[size] = '\0';
+  }
+  return text;
+}
+
+static size_t reports;
+
+static void count_report(const sim_report_t *report) {
+  reports++;
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (double)(end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void power_up(void) {
+  memset(&neo2, 0, sizeof(neo2));
+  sim_init(0);
+  memset(profile_stats, 0, sizeof(profile_stats));
+}
+
+// Latency in ms that percent of the decisions in histogram didn't exceed.
+static unsigned decision_percentile(const uint32_t *histogram, uint32_t total, unsigned percent) {
+  uint32_t seen = 0;
+  for (unsigned ms = 0; ms < SIM_MAX_DECISION_MS; ms++) {
+    seen += histogram[ms];
+    if (seen * 100 >= total * percent) {
+      return ms;
+    }
+  }
+  return SIM_MAX_DECISION_MS;
+}
+
+// Distribution of the time from a dual-role key's press to its tap or hold
+// decision in the last replay. A decision made by another key's event costs
+// that event no extra latency, one made by the end of the tapping term
+// delays the events in between.
+static void print_decisions(const char *kind, const char *path) {
+  const struct {
+    const char *name;
+    const uint32_t *histogram;
+  } kinds[] = { { "tap", sim.tap_decisions }, { "hold", sim.hold_decisions } };
+
+  printf("%s %s: ", kind, path);
+  for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+    uint32_t total = 0;
+    for (unsigned ms = 0; ms <= SIM_MAX_DECISION_MS; ms++) {
+      total += kinds[i].histogram[ms];
+    }
+    printf("%s%s decisions: %u", i ? ", " : "", kinds[i].name, total);
+    if (total) {
+      printf(" (ms p50/p90/p99/max: %u/%u/%u/%u)", decision_percentile(kinds[i].histogram, total, 50),
+             decision_percentile(kinds[i].histogram, total, 90),
+             decision_percentile(kinds[i].histogram, total, 99),
+             decision_percentile(kinds[i].histogram, total, 100));
+    }
+  }
+  printf("\n");
+}
+
+// Replays of each trace, the best one is reported to keep the numbers
+// stable against other load on the host.
+#define BENCH_RUNS 5
+
+// Events per second of the replay (the simulated matrix scans between the
+// events included), HID reports per typed character and the cost of a
+// single key event and scan as measured by NEO2_PROFILE.
+static bool bench_corpus(const char *path) {
+  char *text = read_file(path);
+  if (!text) {
+    perror(path);
+    return false;
+  }
+  size_t skipped;
+  size_t typed = type_text(text, &skipped);
+  free(text);
+  trace_write();
+
+  long events = 0;
+  double seconds = 0;
+  profile_stat_t event = { 0 }, scan = { 0 };
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    power_up();
+    reports = 0;
+    sim_report_hook = count_report;
+    FILE *file = fmemopen(trace.text, trace.text_size, "r");
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    events = sim_replay(file);
+    double run_seconds = seconds_since(&start);
+    fclose(file);
+    sim_report_hook = NULL;
+
+    if (strstr(sim.console, "GUARD:")) {
+      printf("corpus %s: stuck state after the replay:\n%s", path, sim.console);
+      return false;
+    }
+    if (!run || run_seconds < seconds) {
+      seconds = run_seconds;
+    }
+    if (!run || profile_stats[PROFILE_SLOT_EVENT].max < event.max) {
+      event = profile_stats[PROFILE_SLOT_EVENT];
+    }
+    if (!run || profile_stats[PROFILE_SLOT_SCAN].max < scan.max) {
+      scan = profile_stats[PROFILE_SLOT_SCAN];
+    }
+  }
+
+  printf("corpus %s: %zu chars, %zu skipped, %ld events, %.2f reports/char, %.0f events/s, "
+         "event ns avg/worst: %u/%u, scan ns worst: %u\n",
+         path, typed, skipped, events, (double)reports / typed, events / seconds,
+         event.count ? event.total / event.count : 0, event.max, scan.max);
+  print_decisions("corpus", path);
+  return events > 0;
+}
+
+// A recorded trace, e.g. of a programming session, is replayed once for
+// its report count and the decisions of its dual-role keys.
+static bool bench_trace(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  power_up();
+  reports = 0;
+  sim_report_hook = count_report;
+  long events = sim_replay(file);
+  sim_report_hook = NULL;
+  fclose(file);
+
+  printf("trace %s: %ld events, %zu reports\n", path, events, reports);
+  print_decisions("trace", path);
+  return events > 0;
+}
+
+// Rounds of the tab shortcuts recorded into macro 1, 241 events with the
+// release of FKEYS after the record key.
+#define MACRO_ROUNDS 30
+
+// Playback of a macro switching and saving browser tabs, played with FKEYS
+// held. The simulated reports/s are paced by DYNAMIC_MACRO_DELAY, the host
+// ones show what the keymap and the core would manage without the delay.
+static bool bench_macro(void) {
+  static const uint16_t shortcuts[] = { YELDIR_CTLTAB, YELDIR_CTLTAB, YELDIR_CTLSTAB, LCTL(DE_S) };
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  keypos_t play = sim_key(FKEYS, DM_PLY1);
+
+  power_up();
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_REC1));
+  sim_release(fkeys);
+  for (int round = 0; round < MACRO_ROUNDS; round++) {
+    for (size_t i = 0; i < sizeof(shortcuts) / sizeof(shortcuts[0]); i++) {
+      sim_tap(sim_key(NEO_1, shortcuts[i]));
+    }
+  }
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_RSTP));
+
+  double seconds = 0;
+  uint32_t sim_ms = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    sim_press(play);
+    reports = 0;
+    sim_report_hook = count_report;
+    uint32_t sim_start = timer_read32();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sim_release(play);
+    double run_seconds = seconds_since(&start);
+    sim_report_hook = NULL;
+    // The release is followed by a scan 1 ms after the playback.
+    sim_ms = timer_read32() - sim_start - 1;
+    if (!run || run_seconds < seconds) {
+      seconds = run_seconds;
+    }
+  }
+  sim_release(fkeys);
+  sim_wait(2);
+
+  if (strstr(sim.console, "GUARD:")) {
+    printf("macro: stuck state after the playback:\n%s", sim.console);
+    return false;
+  }
+  printf("macro: %d shortcuts, %zu reports in %u ms, %.0f reports/s, host: %.0f reports/s\n",
+         MACRO_ROUNDS * (int)(sizeof(shortcuts) / sizeof(shortcuts[0])), reports, sim_ms,
+         reports * 1000.0 / sim_ms, reports / seconds);
+  return reports > 0;
+}
+
+// Lookups of every key per round of the layer lookup benchmark.
+#define LOOKUP_ROUNDS 100000
+
+static uint16_t lookup_walk(keypos_t key) {
+  return keymaps[layer_switch_get_layer(key)][key.row][key.col];
+}
+
+// Cost of resolving a key's keycode with Mod3 and Mod4 held, once by the
+// core's walk down the active layers to the first non-transparent entry
+// and once as a read of an effective keycode table built from the same
+// walk whenever the layers change. The table is what a cache in front of
+// the walk would cost per key, its build what it would add per layer change.
+static bool bench_lookup(void) {
+  const struct {
+    const char *name;
+    uint16_t    mods[2];
+  } states[] = {
+    { "none", { 0 } },
+    { "mod3", { NEO2_RMOD3 } },
+    { "mod4", { NEO2_RMOD4 } },
+    { "mod3+mod4", { NEO2_RMOD3, NEO2_RMOD4 } },
+  };
+  static uint16_t table[MATRIX_ROWS][MATRIX_COLS];
+  volatile uint16_t sink = 0;
+
+  for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+    power_up();
+    for (size_t m = 0; m < 2 && states[i].mods[m]; m++) {
+      sim_press(sim_key(NEO_1, states[i].mods[m]));
+    }
+
+    double walk = 0, read = 0, build = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (int round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+          for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            sink = lookup_walk((keypos_t){ .row = row, .col = col });
+          }
+        }
+      }
+      double run_walk = seconds_since(&start);
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (int round = 0; round < LOOKUP_ROUNDS / 100; round++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+          for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            table[row][col] = lookup_walk((keypos_t){ .row = row, .col = col });
+          }
+        }
+        sink = table[round % MATRIX_ROWS][0];
+      }
+      double run_build = seconds_since(&start) * 100;
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (int round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+          for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            sink = ((volatile uint16_t *)table)[row * MATRIX_COLS + col];
+          }
+        }
+      }
+      double run_read = seconds_since(&start);
+
+      if (!run || run_walk < walk) {
+        walk = run_walk;
+      }
+      if (!run || run_build < build) {
+        build = run_build;
+      }
+      if (!run || run_read < read) {
+        read = run_read;
+      }
+    }
+
+    double lookups = (double)LOOKUP_ROUNDS * MATRIX_ROWS * MATRIX_COLS;
+    printf("lookup %s: layers 0x%02X, walk ns/key: %.2f, table ns/key: %.2f, "
+           "table build ns: %.0f\n",
+           states[i].name, layer_state, walk * 1e9 / lookups, read * 1e9 / lookups,
+           build * 1e9 / LOOKUP_ROUNDS);
+  }
+  (void)sink;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      ok &= bench_trace(argv[++i]);
+    } else {
+      ok &= bench_corpus(argv[i]);
+    }
+  }
+  ok &= bench_macro();
+  ok &= bench_lookup();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Host stand-in for the parts of the QMK API used by keymap.c. Keycode
+// values follow quantum_keycodes.h; the behaviour lives in sim.c.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Ergodox Infinity matrix
+#define MATRIX_ROWS 18
+#define MATRIX_COLS 5
+
+typedef uint8_t matrix_row_t;
+
+// The 76 keys of the layout fill the matrix row by row.
+#define LAYOUT_ergodox(...) { __VA_ARGS__ }
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+
+// Basic keycodes
+enum hid_keyboard_keypad_usage {
+  KC_NO = 0x00,
+  KC_TRNS,
+  KC_A = 0x04, KC_B, KC_C, KC_D, KC_E, KC_F, KC_G, KC_H, KC_I, KC_J, KC_K, KC_L, KC_M,
+  KC_N, KC_O, KC_P, KC_Q, KC_R, KC_S, KC_T, KC_U, KC_V, KC_W, KC_X, KC_Y, KC_Z,
+  KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_0,
+  KC_ENTER, KC_ESCAPE, KC_BSPC, KC_TAB, KC_SPACE, KC_MINS, KC_EQL, KC_LBRC, KC_RBRC,
+  KC_BSLS, KC_NUHS, KC_SCLN, KC_QUOT, KC_GRAVE, KC_COMMA, KC_DOT, KC_SLASH, KC_CAPS,
+  KC_F1, KC_F2, KC_F3, KC_F4, KC_F5, KC_F6, KC_F7, KC_F8, KC_F9, KC_F10, KC_F11, KC_F12,
+  KC_PSCR, KC_SCRL, KC_PAUS, KC_INSERT, KC_HOME, KC_PGUP, KC_DELETE, KC_END, KC_PGDN,
+  KC_RIGHT, KC_LEFT, KC_DOWN, KC_UP, KC_NUM_LOCK, KC_KP_SLASH, KC_KP_ASTERISK,
+  KC_KP_MINUS, KC_KP_PLUS, KC_KP_ENTER, KC_KP_1, KC_KP_2, KC_KP_3, KC_KP_4, KC_KP_5,
+  KC_KP_6, KC_KP_7, KC_KP_8, KC_KP_9, KC_KP_0, KC_KP_DOT, KC_NUBS, KC_APPLICATION,
+  KC_LOCKING_CAPS_LOCK = 0x82,
+  KC_AUDIO_MUTE = 0xA8, KC_AUDIO_VOL_UP, KC_AUDIO_VOL_DOWN,
+  KC_MEDIA_PLAY_PAUSE = 0xAE,
+  KC_MEDIA_FAST_FORWARD = 0xBB, KC_MEDIA_REWIND,
+  KC_MS_UP = 0xF0, KC_MS_DOWN, KC_MS_LEFT, KC_MS_RIGHT, KC_MS_BTN1, KC_MS_BTN2,
+  KC_MS_WH_UP = 0xF9, KC_MS_WH_DOWN, KC_MS_WH_LEFT, KC_MS_WH_RIGHT,
+  KC_LCTL = 0xE0, KC_LSFT, KC_LALT, KC_LGUI, KC_RCTL, KC_RSFT, KC_RALT, KC_RGUI,
+};
+
+#define KC_ESC    KC_ESCAPE
+#define KC_COMM   KC_COMMA
+#define KC_SLSH   KC_SLASH
+#define KC_GRV    KC_GRAVE
+#define KC_LCTRL  KC_LCTL
+
+#define IS_MOD(code) (KC_LCTL <= (code) && (code) <= KC_RGUI)
+#define MOD_BIT(code) (1 << ((code) & 0x07))
+
+// Quantum keycode ranges
+#define QK_MODS           0x0100
+#define QK_LCTL           0x0100
+#define QK_LSFT           0x0200
+#define QK_LALT           0x0400
+#define QK_LGUI           0x0800
+#define QK_RMODS_MIN      0x1000
+#define QK_RCTL           0x1100
+#define QK_RSFT           0x1200
+#define QK_RALT           0x1400
+#define QK_RGUI           0x1800
+#define QK_MODS_MAX       0x1FFF
+#define QK_LAYER_TAP      0x4000
+#define QK_LAYER_TAP_MAX  0x4FFF
+#define QK_TO             0x5000
+#define QK_TO_MAX         0x50FF
+#define QK_MOMENTARY      0x5100
+#define QK_MOMENTARY_MAX  0x51FF
+#define QK_DYNAMIC_MACRO  0x5C00
+#define QK_MOD_TAP        0x6000
+#define QK_MOD_TAP_MAX    0x7FFF
+
+#define LCTL(kc) (QK_LCTL | (kc))
+#define LSFT(kc) (QK_LSFT | (kc))
+#define LALT(kc) (QK_LALT | (kc))
+#define RALT(kc) (QK_RALT | (kc))
+#define RSA(kc)  (QK_RSFT | QK_RALT | (kc))
+#define C(kc)    LCTL(kc)
+#define S(kc)    LSFT(kc)
+#define ALGR(kc) RALT(kc)
+
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+
+#define LT(layer, kc) (QK_LAYER_TAP | (((layer) & 0xF) << 8) | ((kc) & 0xFF))
+#define TO(layer)     (QK_TO | (1 << 4) | ((layer) & 0xF))
+#define MO(layer)     (QK_MOMENTARY | ((layer) & 0xFF))
+#define MT(mod, kc)   (QK_MOD_TAP | (((mod) & 0x1F) << 8) | ((kc) & 0xFF))
+#define LCA_T(kc)     MT(MOD_LCTL | MOD_LALT, kc)
+
+enum dynamic_macro_keycodes {
+  DM_REC1 = QK_DYNAMIC_MACRO,
+  DM_REC2,
+  DM_RSTP,
+  DM_PLY1,
+  DM_PLY2,
+};
+
+#define SAFE_RANGE 0x5E00
+
+#ifndef TAPPING_TERM
+#  define TAPPING_TERM 200
+#endif
+
+// Key events
+typedef struct {
+  uint8_t col;
+  uint8_t row;
+} keypos_t;
+
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint16_t time;
+} keyevent_t;
+
+typedef struct {
+  bool    interrupted :1;
+  uint8_t count       :4;
+} tap_t;
+
+typedef struct {
+  keyevent_t event;
+  tap_t      tap;
+} keyrecord_t;
+
+bool process_dynamic_macro(uint16_t keycode, keyrecord_t *record);
+
+// Layers
+#if defined(LAYER_STATE_8BIT)
+typedef uint8_t layer_state_t;
+#  define MAX_LAYER 8
+#else
+typedef uint32_t layer_state_t;
+#  define MAX_LAYER 32
+#endif
+
+extern layer_state_t layer_state;
+extern layer_state_t default_layer_state;
+
+void layer_state_set(layer_state_t state);
+void layer_on(uint8_t layer);
+void layer_off(uint8_t layer);
+void layer_move(uint8_t layer);
+bool layer_state_cmp(layer_state_t state, uint8_t layer);
+uint8_t get_highest_layer(layer_state_t state);
+uint8_t layer_switch_get_layer(keypos_t key);
+void update_source_layers_cache(keypos_t key, uint8_t layer);
+uint8_t read_source_layers_cache(keypos_t key);
+layer_state_t layer_state_set_user(layer_state_t state);
+
+// Reports and modifiers
+uint8_t get_mods(void);
+void set_mods(uint8_t mods);
+void clear_mods(void);
+void send_keyboard_report(void);
+void clear_keyboard(void);
+uint8_t has_anykey(void);
+void register_code(uint8_t code);
+void unregister_code(uint8_t code);
+void register_code16(uint16_t code);
+void unregister_code16(uint16_t code);
+void tap_code(uint8_t code);
+void tap_code16(uint16_t code);
+void register_unicode(uint32_t code_point);
+
+typedef union {
+  uint16_t raw;
+  struct {
+    bool nkro :1;
+  };
+} keymap_config_t;
+
+extern keymap_config_t keymap_config;
+
+// Host LEDs
+typedef union {
+  uint8_t raw;
+  struct {
+    bool num_lock    :1;
+    bool caps_lock   :1;
+    bool scroll_lock :1;
+    bool compose     :1;
+    bool kana        :1;
+  };
+} led_t;
+
+// Matrix, timer, EEPROM and console
+matrix_row_t matrix_get_row(uint8_t row);
+
+uint16_t timer_read(void);
+uint32_t timer_read32(void);
+uint16_t timer_elapsed(uint16_t last);
+
+uint32_t eeconfig_read_user(void);
+void eeconfig_update_user(uint32_t val);
+
+void uprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+void raw_hid_send(uint8_t *data, uint8_t length);
+
+// Ergodox LEDs
+void ergodox_board_led_off(void);
+void ergodox_right_led_1_on(void);
+void ergodox_right_led_1_off(void);
+void ergodox_right_led_2_on(void);
+void ergodox_right_led_2_off(void);
+void ergodox_right_led_3_on(void);
+void ergodox_right_led_3_off(void);
@@ -0,0 +1,44 @@
+// Replays a `KL:` trace through the keymap and prints each keyboard report
+// with its time, run with `make -C test replay TRACE=session.log`.
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static size_t reports;
+
+static void print_report(const sim_report_t *report) {
+  printf("%8u ms  mods: 0x%02X  keys:", report->time, report->mods);
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (report->keys[i]) {
+      printf(" 0x%02X", report->keys[i]);
+    }
+  }
+  printf("\n");
+  reports++;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <trace | ->\n", argv[0]);
+    return 2;
+  }
+  FILE *trace = strcmp(argv[1], "-") ? fopen(argv[1], "r") : stdin;
+  if (!trace) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  sim_init(0);
+  sim_report_hook = print_report;
+  long events = sim_replay(trace);
+  if (events < 0) {
+    fprintf(stderr, "%s: can't read the trace\n", argv[1]);
+    return 1;
+  }
+  for (size_t i = 0; i < sim.unicode_count; i++) {
+    printf("U+%04X%s", sim.unicode[i], i + 1 < sim.unicode_count ? " " : "\n");
+  }
+  printf("%ld key events, %zu reports\n", events, reports);
+  return 0;
+}
@@ -0,0 +1,740 @@
+// Host simulation of the QMK core, see sim.h.
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Provided by keymap.c
+extern const uint16_t keymaps[][MATRIX_ROWS][MATRIX_COLS];
+bool process_record_user(uint16_t keycode, keyrecord_t *record);
+void matrix_init_user(void);
+void matrix_scan_user(void);
+void keyboard_post_init_user(void);
+bool led_update_user(led_t led_state);
+#ifdef RETRO_TAPPING_PER_KEY
+bool get_retro_tapping(uint16_t keycode, keyrecord_t *record);
+#endif
+#ifdef TAPPING_TERM_PER_KEY
+uint16_t get_tapping_term(uint16_t keycode, keyrecord_t *record);
+#endif
+#ifdef HOLD_ON_OTHER_KEY_PRESS_PER_KEY
+bool get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record);
+#endif
+#ifdef PERMISSIVE_HOLD_PER_KEY
+bool get_permissive_hold(uint16_t keycode, keyrecord_t *record);
+#endif
+
+sim_log_t sim;
+void (*sim_report_hook)(const sim_report_t *report);
+
+layer_state_t layer_state;
+layer_state_t default_layer_state;
+keymap_config_t keymap_config;
+
+static uint32_t now;
+static uint8_t mods;
+static uint8_t weak_mods;
+static uint8_t keys[SIM_REPORT_KEYS];
+static led_t host_leds;
+static matrix_row_t matrix[MATRIX_ROWS];
+static uint8_t source_layers[MATRIX_ROWS][MATRIX_COLS];
+static keypos_t last_pressed;
+static sim_report_t last_sent;
+
+// Dynamic macros, see process_dynamic_macro().
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint8_t  tap_count;
+} macro_event_t;
+
+static macro_event_t macro_buffer[DYNAMIC_MACRO_SIZE];
+static macro_event_t *const r_macro_buffer = &macro_buffer[DYNAMIC_MACRO_SIZE - 1];
+static macro_event_t *macro_pointer;
+static macro_event_t *macro_end;
+static macro_event_t *r_macro_end;
+static uint8_t macro_id;
+
+void sim_init(uint32_t eeprom_user) {
+  memset(&sim, 0, sizeof(sim));
+  sim.eeprom_user = eeprom_user;
+
+  now = 0;
+  mods = 0;
+  weak_mods = 0;
+  memset(keys, 0, sizeof(keys));
+  host_leds.raw = 0;
+  memset(matrix, 0, sizeof(matrix));
+  memset(source_layers, 0, sizeof(source_layers));
+  macro_id = 0;
+  macro_end = macro_buffer;
+  r_macro_end = r_macro_buffer;
+  last_pressed = (keypos_t){ 0xFF, 0xFF };
+  memset(&last_sent, 0, sizeof(last_sent));
+  layer_state = 0;
+  default_layer_state = 1;
+  keymap_config.raw = 0;
+
+  matrix_init_user();
+  keyboard_post_init_user();
+}
+
+void sim_clear_log(void) {
+  sim.report_count = 0;
+  sim.unicode_count = 0;
+  sim.console_len = 0;
+  sim.console[0] = '\0';
+  sim.led_writes = 0;
+}
+
+// Host
+
+static void host_toggle_lock(uint8_t keycode) {
+  if (keycode == KC_CAPS) {
+    host_leds.caps_lock = !host_leds.caps_lock;
+  } else if (keycode == KC_NUM_LOCK) {
+    host_leds.num_lock = !host_leds.num_lock;
+  } else {
+    return;
+  }
+  led_update_user(host_leds);
+}
+
+void sim_set_host_leds(uint8_t raw) {
+  host_leds.raw = raw;
+  led_update_user(host_leds);
+}
+
+bool sim_report_has(const sim_report_t *report, uint8_t keycode) {
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (report->keys[i] == keycode) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const sim_report_t *sim_last_report(void) {
+  static const sim_report_t empty;
+  return sim.report_count ? &sim.reports[sim.report_count - 1] : &empty;
+}
+
+// Reports and modifiers
+
+void send_keyboard_report(void) {
+  sim_report_t report = { .time = now, .mods = mods | weak_mods };
+  memcpy(report.keys, keys, sizeof(keys));
+
+  // The host toggles its lock state on the press of a lock key.
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (report.keys[i] && !sim_report_has(&last_sent, report.keys[i])) {
+      host_toggle_lock(report.keys[i]);
+    }
+  }
+  last_sent = report;
+
+  if (sim_report_hook) {
+    sim_report_hook(&report);
+    return;
+  }
+  if (sim.report_count == SIM_MAX_REPORTS) {
+    fprintf(stderr, "sim: report log full\n");
+    abort();
+  }
+  sim.reports[sim.report_count++] = report;
+}
+
+uint8_t get_mods(void) { return mods; }
+void set_mods(uint8_t new_mods) { mods = new_mods; }
+void clear_mods(void) { mods = 0; }
+
+void clear_keyboard(void) {
+  mods = 0;
+  weak_mods = 0;
+  memset(keys, 0, sizeof(keys));
+  send_keyboard_report();
+}
+
+uint8_t has_anykey(void) {
+  uint8_t count = 0;
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    count += keys[i] != KC_NO;
+  }
+  return count;
+}
+
+static void add_key(uint8_t code) {
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (keys[i] == code) {
+      return;
+    }
+  }
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (keys[i] == KC_NO) {
+      keys[i] = code;
+      return;
+    }
+  }
+}
+
+static void del_key(uint8_t code) {
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (keys[i] == code) {
+      keys[i] = KC_NO;
+    }
+  }
+}
+
+void register_code(uint8_t code) {
+  if (code == KC_NO) {
+    return;
+  }
+  if (code == KC_LOCKING_CAPS_LOCK) {
+    // Locking keys only send a tap if the host state differs.
+    if (!host_leds.caps_lock) {
+      tap_code(KC_CAPS);
+    }
+    return;
+  }
+  if (IS_MOD(code)) {
+    mods |= MOD_BIT(code);
+  } else {
+    add_key(code);
+  }
+  send_keyboard_report();
+}
+
+void unregister_code(uint8_t code) {
+  if (code == KC_NO) {
+    return;
+  }
+  if (code == KC_LOCKING_CAPS_LOCK) {
+    if (host_leds.caps_lock) {
+      tap_code(KC_CAPS);
+    }
+    return;
+  }
+  if (IS_MOD(code)) {
+    mods &= ~MOD_BIT(code);
+  } else {
+    del_key(code);
+  }
+  send_keyboard_report();
+}
+
+// 8-bit modifier mask of the 5-bit modifier field of a quantum keycode.
+static uint8_t mods_of(uint16_t code) {
+  uint8_t mods5 = (code >> 8) & 0x1F;
+  return (mods5 & 0x10) ? (mods5 & 0x0F) << 4 : mods5;
+}
+
+void register_code16(uint16_t code) {
+  uint8_t code_mods = mods_of(code);
+  if (code_mods) {
+    if (IS_MOD(code & 0xFF) || (code & 0xFF) == KC_NO) {
+      mods |= code_mods;
+    } else {
+      weak_mods |= code_mods;
+    }
+    send_keyboard_report();
+  }
+  register_code(code & 0xFF);
+}
+
+void unregister_code16(uint16_t code) {
+  uint8_t code_mods = mods_of(code);
+  unregister_code(code & 0xFF);
+  if (code_mods) {
+    if (IS_MOD(code & 0xFF) || (code & 0xFF) == KC_NO) {
+      mods &= ~code_mods;
+    } else {
+      weak_mods &= ~code_mods;
+    }
+    send_keyboard_report();
+  }
+}
+
+void tap_code(uint8_t code) {
+  register_code(code);
+  unregister_code(code);
+}
+
+void tap_code16(uint16_t code) {
+  register_code16(code);
+  unregister_code16(code);
+}
+
+void register_unicode(uint32_t code_point) {
+  if (sim.unicode_count < SIM_MAX_UNICODE) {
+    sim.unicode[sim.unicode_count++] = code_point;
+  }
+}
+
+// Layers
+
+void layer_state_set(layer_state_t state) {
+  layer_state = layer_state_set_user(state);
+}
+
+void layer_on(uint8_t layer) { layer_state_set(layer_state | ((layer_state_t)1 << layer)); }
+void layer_off(uint8_t layer) { layer_state_set(layer_state & ~((layer_state_t)1 << layer)); }
+void layer_move(uint8_t layer) { layer_state_set((layer_state_t)1 << layer); }
+
+bool layer_state_cmp(layer_state_t state, uint8_t layer) {
+  if (!state) {
+    return layer == 0;
+  }
+  return (state & ((layer_state_t)1 << layer)) != 0;
+}
+
+uint8_t get_highest_layer(layer_state_t state) {
+  uint8_t layer = 0;
+  while (state >>= 1) {
+    layer++;
+  }
+  return layer;
+}
+
+uint8_t layer_switch_get_layer(keypos_t key) {
+  layer_state_t layers = layer_state | default_layer_state;
+  for (int8_t layer = MAX_LAYER - 1; layer >= 0; layer--) {
+    if ((layers & ((layer_state_t)1 << layer)) && keymaps[layer][key.row][key.col] != KC_TRNS) {
+      return layer;
+    }
+  }
+  return 0;
+}
+
+void update_source_layers_cache(keypos_t key, uint8_t layer) {
+  source_layers[key.row][key.col] = layer;
+}
+
+uint8_t read_source_layers_cache(keypos_t key) {
+  return source_layers[key.row][key.col];
+}
+
+// Core key handling
+
+keypos_t sim_key(uint8_t layer, uint16_t keycode) {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      if (keymaps[layer][row][col] == keycode) {
+        return (keypos_t){ .col = col, .row = row };
+      }
+    }
+  }
+  fprintf(stderr, "sim: keycode 0x%04X not on layer %u\n", keycode, layer);
+  abort();
+}
+
+// process_dynamic_macro() runs in front of the keymap. Starting a
+// recording, on the release of a record key, clears the keyboard and the
+// layers. The events that follow are stored and processed as usual until
+// a macro key stops the recording. Macro 1 fills the buffer from its
+// start, macro 2 from its end.
+static void process_event(keypos_t key, bool pressed, uint8_t tap_count);
+
+static void layer_clear(void) { layer_state_set(0); }
+
+static void macro_record_end(macro_event_t *buffer, int8_t direction, macro_event_t **end) {
+  // Keys still held when stopping, like the one of the macro key's layer,
+  // are not part of the macro.
+  while (macro_pointer != buffer && (macro_pointer - direction)->pressed) {
+    macro_pointer -= direction;
+  }
+  *end = macro_pointer;
+}
+
+// The firmware blocks during playback, the matrix isn't scanned.
+static void macro_play(macro_event_t *buffer, macro_event_t *end, int8_t direction) {
+  layer_state_t saved_layer_state = layer_state;
+  clear_keyboard();
+  layer_clear();
+  for (; buffer != end; buffer += direction) {
+    process_event(buffer->key, buffer->pressed, buffer->tap_count);
+    now += DYNAMIC_MACRO_DELAY;
+  }
+  clear_keyboard();
+  layer_state_set(saved_layer_state);
+}
+
+bool process_dynamic_macro(uint16_t keycode, keyrecord_t *record) {
+  bool macro_key = keycode >= DM_REC1 && keycode <= DM_PLY2;
+  bool pressed = record->event.pressed;
+
+  if (!macro_id) {
+    if (!macro_key || pressed || keycode == DM_RSTP) {
+      return true;
+    }
+    if (keycode == DM_REC1 || keycode == DM_REC2) {
+      clear_keyboard();
+      layer_clear();
+      macro_id = keycode == DM_REC1 ? 1 : 2;
+      macro_pointer = macro_id == 1 ? macro_buffer : r_macro_buffer;
+    } else if (keycode == DM_PLY1) {
+      macro_play(macro_buffer, macro_end, +1);
+    } else {
+      macro_play(r_macro_buffer, r_macro_end, -1);
+    }
+    return false;
+  }
+
+  if (macro_key) {
+    // The release of the record key that started the recording doesn't
+    // stop it, the press of the stop key does.
+    if (pressed ^ (keycode != DM_RSTP)) {
+      if (macro_id == 1) {
+        macro_record_end(macro_buffer, +1, &macro_end);
+      } else {
+        macro_record_end(r_macro_buffer, -1, &r_macro_end);
+      }
+      macro_id = 0;
+    }
+    return false;
+  }
+
+  // Events that would run into the other macro are dropped.
+  int8_t direction = macro_id == 1 ? +1 : -1;
+  if (macro_pointer + direction != (macro_id == 1 ? r_macro_end : macro_end)) {
+    *macro_pointer = (macro_event_t){ record->event.key, pressed, record->tap.count };
+    macro_pointer += direction;
+  }
+  return true;
+}
+
+// The core's action for keycode, after process_record_user returned true.
+// retro_tap taps a held dual-role key on release.
+static void core_action(uint16_t keycode, bool pressed, uint8_t tap_count, bool retro_tap) {
+  if (keycode <= 0xFF) {
+    if (pressed) {
+      register_code(keycode);
+    } else {
+      unregister_code(keycode);
+    }
+  } else if (keycode <= QK_MODS_MAX) {
+    if (pressed) {
+      register_code16(keycode);
+    } else {
+      unregister_code16(keycode);
+    }
+  } else if (keycode >= QK_LAYER_TAP && keycode <= QK_LAYER_TAP_MAX) {
+    uint8_t layer = (keycode >> 8) & 0x0F;
+    if (tap_count) {
+      core_action(keycode & 0xFF, pressed, 0, false);
+    } else if (pressed) {
+      layer_on(layer);
+    } else {
+      layer_off(layer);
+      if (retro_tap) {
+        tap_code(keycode & 0xFF);
+      }
+    }
+  } else if (keycode >= QK_TO && keycode <= QK_TO_MAX) {
+    if (pressed) {
+      layer_move(keycode & 0x0F);
+    }
+  } else if (keycode >= QK_MOMENTARY && keycode <= QK_MOMENTARY_MAX) {
+    if (pressed) {
+      layer_on(keycode & 0xFF);
+    } else {
+      layer_off(keycode & 0xFF);
+    }
+  } else if (keycode >= QK_MOD_TAP && keycode <= QK_MOD_TAP_MAX) {
+    if (tap_count) {
+      core_action(keycode & 0xFF, pressed, 0, false);
+    } else {
+      if (pressed) {
+        mods |= mods_of(keycode);
+      } else {
+        mods &= ~mods_of(keycode);
+      }
+      send_keyboard_report();
+      if (retro_tap) {
+        tap_code(keycode & 0xFF);
+      }
+    }
+  }
+}
+
+static bool is_dual_role(uint16_t keycode) {
+  return (keycode >= QK_LAYER_TAP && keycode <= QK_LAYER_TAP_MAX)
+      || (keycode >= QK_MOD_TAP && keycode <= QK_MOD_TAP_MAX);
+}
+
+// process_record(): the event's keycode from the layers, or for a release
+// from the layer the key was pressed on, through the dynamic macros and the
+// keymap to the core's action.
+static void process_event(keypos_t key, bool pressed, uint8_t tap_count) {
+  bool alone = key.row == last_pressed.row && key.col == last_pressed.col;
+  if (pressed) {
+    source_layers[key.row][key.col] = layer_switch_get_layer(key);
+    last_pressed = key;
+  }
+
+  uint16_t keycode = keymaps[source_layers[key.row][key.col]][key.row][key.col];
+  keyrecord_t record = {
+    .event = { .key = key, .pressed = pressed, .time = (uint16_t)now },
+    .tap = { .count = tap_count },
+  };
+
+  bool retro_tap = false;
+#ifdef RETRO_TAPPING_PER_KEY
+  // A dual-role key held and released without another key in between.
+  retro_tap = !pressed && !tap_count && alone && is_dual_role(keycode)
+           && get_retro_tapping(keycode, &record);
+#endif
+  (void)alone;
+
+#ifndef DYNAMIC_MACRO_USER_CALL
+  if (!process_dynamic_macro(keycode, &record)) {
+    return;
+  }
+#endif
+  if (process_record_user(keycode, &record)) {
+    core_action(keycode, pressed, tap_count, retro_tap);
+  }
+}
+
+static void key_event(keypos_t key, bool pressed, uint8_t tap_count) {
+  if (pressed) {
+    matrix[key.row] |= (matrix_row_t)1 << key.col;
+  } else {
+    matrix[key.row] &= ~((matrix_row_t)1 << key.col);
+  }
+
+  // The keyboard's matrix_scan() ends in matrix_scan_user, before the core
+  // handles the events of the scan.
+  matrix_scan_user();
+  process_event(key, pressed, tap_count);
+  sim_wait(1);
+}
+
+void sim_press(keypos_t key) { key_event(key, true, 0); }
+void sim_release(keypos_t key) { key_event(key, false, 0); }
+
+void sim_tap(keypos_t key) {
+  uint8_t tap_count = is_dual_role(keymaps[layer_switch_get_layer(key)][key.row][key.col]) ? 1 : 0;
+  key_event(key, true, tap_count);
+  key_event(key, false, tap_count);
+}
+
+void sim_wait(uint16_t ms) {
+  while (ms--) {
+    now++;
+    matrix_scan_user();
+  }
+}
+
+// Trace replay
+
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint16_t keycode;
+  uint32_t time;
+  size_t   line;
+  uint8_t  tap_count;
+} replay_event_t;
+
+static bool same_key(keypos_t a, keypos_t b) { return a.row == b.row && a.col == b.col; }
+
+static uint16_t tapping_term(uint16_t keycode, keyrecord_t *record) {
+#ifdef TAPPING_TERM_PER_KEY
+  return get_tapping_term(keycode, record);
+#else
+  return TAPPING_TERM;
+#endif
+}
+
+static bool hold_on_other_key_press(uint16_t keycode, keyrecord_t *record) {
+#if defined(HOLD_ON_OTHER_KEY_PRESS_PER_KEY)
+  return get_hold_on_other_key_press(keycode, record);
+#elif defined(HOLD_ON_OTHER_KEY_PRESS)
+  return true;
+#else
+  return false;
+#endif
+}
+
+static bool permissive_hold(uint16_t keycode, keyrecord_t *record) {
+#if defined(PERMISSIVE_HOLD_PER_KEY)
+  return get_permissive_hold(keycode, record);
+#elif defined(PERMISSIVE_HOLD)
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Whether the dual-role key pressed at events[i] is a tap, the way the
+// core's tap-hold engine decides it: released within its tapping term,
+// before a press of another key (hold on other key press) or the release
+// of a key pressed after it (permissive hold) makes it a hold. decided is
+// set to the time of the decision.
+static bool replay_is_tap(const replay_event_t *events, size_t count, size_t i, uint32_t *decided) {
+  const replay_event_t *press = &events[i];
+  keyrecord_t record = { .event = { .key = press->key, .pressed = true, .time = (uint16_t)press->time } };
+  uint32_t deadline = press->time + tapping_term(press->keycode, &record);
+
+  for (size_t j = i + 1; j < count && events[j].time < deadline; j++) {
+    *decided = events[j].time;
+    if (same_key(events[j].key, press->key)) {
+      return !events[j].pressed;
+    }
+    if (events[j].pressed) {
+      if (hold_on_other_key_press(press->keycode, &record)) {
+        return false;
+      }
+    } else if (permissive_hold(press->keycode, &record)) {
+      for (size_t k = i + 1; k < j; k++) {
+        if (events[k].pressed && same_key(events[k].key, events[j].key)) {
+          return false;
+        }
+      }
+    }
+  }
+  *decided = deadline;
+  return false;
+}
+
+long sim_replay(FILE *trace) {
+  replay_event_t *events = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+  char line[256];
+  size_t line_number = 0;
+  uint16_t last_time = 0;
+
+  while (fgets(line, sizeof(line), trace)) {
+    line_number++;
+    // `qmk console` puts the device name in front of each line.
+    const char *kl = strstr(line, "KL: ");
+    unsigned keycode, col, row, pressed, time;
+    if (!kl || sscanf(kl, "KL: kc: 0x%x, col: %u, row: %u, pressed: %u, time: %u",
+                      &keycode, &col, &row, &pressed, &time) != 5) {
+      continue;
+    }
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) {
+      fprintf(stderr, "sim: trace line %zu: no key at row %u, col %u\n", line_number, row, col);
+      free(events);
+      return -1;
+    }
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      events = realloc(events, capacity * sizeof(*events));
+      if (!events) {
+        return -1;
+      }
+    }
+    // The trace has the 16-bit timer, which wraps every 65.5 seconds.
+    uint32_t elapsed = count ? (uint16_t)(time - last_time) : 0;
+    events[count] = (replay_event_t){
+      .key = { .col = (uint8_t)col, .row = (uint8_t)row },
+      .pressed = pressed != 0,
+      .keycode = (uint16_t)keycode,
+      .time = (count ? events[count - 1].time : now) + elapsed,
+      .line = line_number,
+    };
+    last_time = (uint16_t)time;
+    count++;
+  }
+  if (ferror(trace)) {
+    free(events);
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    replay_event_t *event = &events[i];
+    if (event->pressed) {
+      if (is_dual_role(event->keycode)) {
+        uint32_t decided;
+        event->tap_count = replay_is_tap(events, count, i, &decided);
+        uint32_t latency = decided - event->time;
+        uint32_t *histogram = event->tap_count ? sim.tap_decisions : sim.hold_decisions;
+        histogram[latency < SIM_MAX_DECISION_MS ? latency : SIM_MAX_DECISION_MS]++;
+      }
+    } else {
+      // A release belongs to the same tap or hold as its press.
+      for (size_t j = i; j-- > 0;) {
+        if (same_key(events[j].key, event->key)) {
+          event->tap_count = events[j].pressed ? events[j].tap_count : 0;
+          break;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const replay_event_t *event = &events[i];
+    // Events of the same scan follow each other a millisecond apart.
+    if (event->time > now) {
+      uint32_t wait = event->time - now;
+      while (wait > UINT16_MAX) {
+        sim_wait(UINT16_MAX);
+        wait -= UINT16_MAX;
+      }
+      sim_wait((uint16_t)wait);
+    }
+
+    keypos_t key = event->key;
+    uint8_t layer = event->pressed ? layer_switch_get_layer(key) : source_layers[key.row][key.col];
+    uint16_t keycode = keymaps[layer][key.row][key.col];
+    if (keycode != event->keycode) {
+      fprintf(stderr, "sim: trace line %zu: kc 0x%04X, the keymap has 0x%04X\n",
+              event->line, event->keycode, keycode);
+    }
+    key_event(key, event->pressed, event->tap_count);
+  }
+
+  free(events);
+  return (long)count;
+}
+
+// Matrix, timer, EEPROM, console, raw HID and LEDs
+
+matrix_row_t matrix_get_row(uint8_t row) { return matrix[row]; }
+
+uint16_t timer_read(void) { return (uint16_t)now; }
+uint32_t timer_read32(void) { return now; }
+uint16_t timer_elapsed(uint16_t last) { return (uint16_t)((uint16_t)now - last); }
+
+uint32_t eeconfig_read_user(void) { return sim.eeprom_user; }
+
+void eeconfig_update_user(uint32_t val) {
+  if (val != sim.eeprom_user) {
+    sim.eeprom_user = val;
+    sim.eeprom_writes++;
+  }
+}
+
+void uprintf(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(sim.console + sim.console_len, sizeof(sim.console) - sim.console_len, fmt, args);
+  va_end(args);
+  if (len > 0) {
+    sim.console_len += (size_t)len;
+    if (sim.console_len >= sizeof(sim.console)) {
+      sim.console_len = sizeof(sim.console) - 1;
+    }
+  }
+}
+
+void raw_hid_send(uint8_t *data, uint8_t length) {
+  memcpy(sim.raw_hid, data, length < sizeof(sim.raw_hid) ? length : sizeof(sim.raw_hid));
+}
+
+static void led_write(uint8_t led, bool on) {
+  sim.leds[led] = on;
+  sim.led_writes++;
+}
+
+void ergodox_board_led_off(void) { led_write(0, false); }
+void ergodox_right_led_1_on(void) { led_write(1, true); }
+void ergodox_right_led_1_off(void) { led_write(1, false); }
+void ergodox_right_led_2_on(void) { led_write(2, true); }
+void ergodox_right_led_2_off(void) { led_write(2, false); }
+void ergodox_right_led_3_on(void) { led_write(3, true); }
+void ergodox_right_led_3_off(void) { led_write(3, false); }
@@ -0,0 +1,78 @@
+// Host simulation of the QMK core around keymap.c: key events go through
+// the layer lookup and process_record_user like on the keyboard, and every
+// keyboard report, Unicode codepoint and console line is recorded.
+#pragma once
+
+#include <stdio.h>
+
+#include "quantum.h"
+
+#define SIM_REPORT_KEYS 16
+#define SIM_MAX_REPORTS 8192
+#define SIM_MAX_UNICODE 256
+#define SIM_MAX_DECISION_MS 500
+
+typedef struct {
+  uint32_t time;  // ms since power up
+  uint8_t  mods;
+  uint8_t  keys[SIM_REPORT_KEYS];
+} sim_report_t;
+
+typedef struct {
+  sim_report_t reports[SIM_MAX_REPORTS];
+  size_t       report_count;
+  uint32_t     unicode[SIM_MAX_UNICODE];
+  size_t       unicode_count;
+  char         console[16384];
+  size_t       console_len;
+  uint8_t      raw_hid[32];
+  bool         leds[4];
+  uint32_t     led_writes;
+  // Dual-role keys decided by sim_replay(), counted by the milliseconds
+  // from the press to the event that decided them (or the end of the
+  // tapping term). Slower decisions count in the last entry.
+  uint32_t     tap_decisions[SIM_MAX_DECISION_MS + 1];
+  uint32_t     hold_decisions[SIM_MAX_DECISION_MS + 1];
+  uint32_t     eeprom_user;
+  uint32_t     eeprom_writes;
+} sim_log_t;
+
+extern sim_log_t sim;
+
+// Reports go to this hook instead of the log while it is set, e.g. to
+// stream the reports of a long replay.
+extern void (*sim_report_hook)(const sim_report_t *report);
+
+// Power up the keyboard with the given EEPROM user word.
+void sim_init(uint32_t eeprom_user);
+
+// Position of keycode on layer, aborts if the layer doesn't have it.
+keypos_t sim_key(uint8_t layer, uint16_t keycode);
+
+// Key events. Dual-role keys pressed with sim_press() are held, sim_tap()
+// taps them. Every event is followed by one matrix scan.
+void sim_press(keypos_t key);
+void sim_release(keypos_t key);
+void sim_tap(keypos_t key);
+
+// Let ms milliseconds pass, scanning once per millisecond.
+void sim_wait(uint16_t ms);
+
+// Replay a trace of `KL:` lines as printed with NEO2_TRACE, other lines are
+// skipped. Each event happens at its recorded time, relative to the first
+// one, but not before the previous event's scan. The trace doesn't tell how
+// the core resolved dual-role keys, so they are decided as tap or hold from
+// the events that follow with the keymap's tapping settings. Keycodes that
+// differ from the recorded ones are reported on stderr. Returns the number
+// of events replayed, or -1 if the trace can't be read.
+long sim_replay(FILE *trace);
+
+// Host side of the lock LEDs.
+void sim_set_host_leds(uint8_t raw);
+
+// Forget the recorded reports, codepoints, console output and LED writes.
+void sim_clear_log(void);
+
+// Whether a report holds keycode, and the last report sent.
+bool sim_report_has(const sim_report_t *report, uint8_t keycode);
+const sim_report_t *sim_last_report(void);
@@ -0,0 +1,1252 @@
+// Host tests of keymap.c, run with `make -C test`. Each test gets a fresh
+// process, so the static state of the keymap starts from power-up.
+#include "../keymap.c"
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      exit(1);                                                            \
+    }                                                                     \
+  } while (0)
+
+// Number of reports holding keycode that the previous report didn't hold.
+static size_t presses_of(uint8_t keycode) {
+  size_t presses = 0;
+  for (size_t i = 0; i < sim.report_count; i++) {
+    if (sim_report_has(&sim.reports[i], keycode)
+        && (i == 0 || !sim_report_has(&sim.reports[i - 1], keycode))) {
+      presses++;
+    }
+  }
+  return presses;
+}
+
+// Modifiers of the first report holding keycode.
+static uint8_t mods_with(uint8_t keycode) {
+  for (size_t i = 0; i < sim.report_count; i++) {
+    if (sim_report_has(&sim.reports[i], keycode)) {
+      return sim.reports[i].mods;
+    }
+  }
+  return 0xFF;
+}
+
+static bool report_is_empty(const sim_report_t *report) {
+  for (size_t i = 0; i < SIM_REPORT_KEYS; i++) {
+    if (report->keys[i]) {
+      return false;
+    }
+  }
+  return report->mods == 0;
+}
+
+static void hid_command(uint8_t command, uint8_t arg) {
+  uint8_t data[32] = { command, arg };
+  raw_hid_receive(data, sizeof(data));
+}
+
+// Power cycle the keyboard with the given EEPROM user word.
+static void power_up(uint32_t eeprom_user) {
+  memset(&neo2, 0, sizeof(neo2));
+  sim_init(eeprom_user);
+}
+
+static void test_shifted_digit(void) {
+  keypos_t one = sim_key(NEO_1, NEO2_1);
+  keypos_t shift = sim_key(NEO_1, KC_LSFT);
+
+  keypos_t three = sim_key(NEO_1, NEO2_3);
+  keypos_t rshift = sim_key(NEO_1, KC_RSFT);
+
+  sim_tap(one);
+  CHECK(sim.report_count == 2);
+  CHECK(presses_of(KC_1) == 1);
+  CHECK(mods_with(KC_1) == 0);
+  CHECK(report_is_empty(sim_last_report()));
+
+  // The shifted symbol keeps the held Shift: a press and a release report.
+  sim_press(shift);
+  sim_clear_log();
+  sim_tap(one);
+  CHECK(sim.report_count == 2);
+  CHECK(presses_of(KC_1) == 0);
+  CHECK(mods_with(KC_GRAVE) == MOD_BIT(KC_LSFT));
+  CHECK(sim_last_report()->mods == MOD_BIT(KC_LSFT));
+
+  // Other modifiers cost one more report to restore the held ones.
+  sim_clear_log();
+  sim_tap(three);
+  CHECK(sim.report_count == 3);
+  CHECK(mods_with(KC_1) == MOD_BIT(KC_RALT));
+  CHECK(sim_last_report()->mods == MOD_BIT(KC_LSFT));
+  sim_release(shift);
+  CHECK(report_is_empty(sim_last_report()));
+
+  sim_press(rshift);
+  sim_clear_log();
+  sim_tap(one);
+  CHECK(sim.report_count == 3);
+  CHECK(mods_with(KC_GRAVE) == MOD_BIT(KC_LSFT));
+  CHECK(sim_last_report()->mods == MOD_BIT(KC_RSFT));
+  sim_release(rshift);
+  CHECK(report_is_empty(sim_last_report()));
+}
+
+static void test_caps_combo(void) {
+  keypos_t lshift = sim_key(NEO_1, KC_LSFT);
+  keypos_t rshift = sim_key(NEO_1, KC_RSFT);
+
+  sim_press(lshift);
+  sim_press(rshift);
+  sim_release(rshift);
+  sim_release(lshift);
+  CHECK(presses_of(KC_CAPS) == 1);
+  CHECK(neo2.host_leds.caps_lock);
+
+  sim_press(rshift);
+  sim_press(lshift);
+  sim_release(lshift);
+  sim_release(rshift);
+  CHECK(presses_of(KC_CAPS) == 2);
+  CHECK(!neo2.host_leds.caps_lock);
+}
+
+// Keys typed or held while both shifts are down still go through.
+static void test_caps_combo_chord_events(void) {
+  keypos_t lshift = sim_key(NEO_1, KC_LSFT);
+  keypos_t rshift = sim_key(NEO_1, KC_RSFT);
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t up = sim_key(NEO_4, NEO2_NAV_UP);
+  static const uint16_t letters[] = { DE_X, DE_V, DE_L, DE_C, DE_W };
+
+  sim_press(lshift);
+  sim_press(rshift);
+  for (size_t i = 0; i < sizeof(letters) / sizeof(letters[0]); i++) {
+    sim_tap(sim_key(NEO_1, letters[i]));
+    CHECK(presses_of(letters[i]) == 1);
+    CHECK(mods_with(letters[i]) & MODS_SHIFT);
+  }
+  sim_tap(sim_key(NEO_1, NEO2_1));
+  CHECK(presses_of(KC_GRAVE) == 1);
+
+  // A held letter stays in the report for the host to repeat.
+  keypos_t held = sim_key(NEO_1, DE_N);
+  sim_press(held);
+  sim_wait(1000);
+  CHECK(sim_report_has(sim_last_report(), DE_N));
+  sim_release(held);
+  CHECK(presses_of(DE_N) == 1);
+
+  // The arrows repeat on the keyboard.
+  sim_press(lmod4);
+  sim_press(up);
+  sim_wait(NEO2_NAV_REPEAT_DELAY - 2);
+  CHECK(presses_of(KC_UP) == 1);
+  sim_wait(NEO2_NAV_REPEAT_INTERVAL);
+  CHECK(presses_of(KC_UP) == 2);
+  CHECK(mods_with(KC_UP) & MODS_SHIFT);
+  sim_release(up);
+  sim_release(lmod4);
+
+  sim_release(rshift);
+  sim_release(lshift);
+  CHECK(presses_of(KC_CAPS) == 1);
+  CHECK(report_is_empty(sim_last_report()));
+}
+
+static void test_mod4_lock(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t rmod4 = sim_key(NEO_1, NEO2_RMOD4);
+
+  sim_press(lmod4);
+  CHECK(layer_state_cmp(layer_state, NEO_4));
+  sim_release(lmod4);
+  CHECK(!layer_state_cmp(layer_state, NEO_4));
+
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(lmod4);
+  sim_release(rmod4);
+  CHECK(layer_state_cmp(layer_state, NEO_4));
+  CHECK(sim.leds[2]);
+
+  // The lock LED stays on below Mod3.
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  sim_press(lmod3);
+  CHECK(neo2.current_layer == NEO_6);
+  CHECK(sim.leds[2] && !sim.leds[1]);
+  sim_release(lmod3);
+  CHECK(neo2.current_layer == NEO_4);
+  CHECK(sim.leds[2]);
+
+  sim_press(rmod4);
+  sim_press(lmod4);
+  sim_release(rmod4);
+  sim_release(lmod4);
+  CHECK(!layer_state_cmp(layer_state, NEO_4));
+  CHECK(!sim.leds[2]);
+}
+
+// The LEDs are written once per change of the indicated layers and never
+// while scanning.
+static void test_led_writes(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t rmod4 = sim_key(NEO_1, NEO2_RMOD4);
+
+  sim_clear_log();
+  sim_wait(1000);
+  sim_tap(sim_key(NEO_1, DE_X));
+  CHECK(sim.led_writes == 0);
+
+  sim_press(lmod4);
+  CHECK(sim.led_writes == 1 && sim.leds[2]);
+  sim_wait(1000);
+  CHECK(sim.led_writes == 1);
+  sim_press(lmod3);
+  CHECK(sim.led_writes == 2 && !sim.leds[2]);
+  sim_release(lmod3);
+  CHECK(sim.led_writes == 3 && sim.leds[2]);
+  sim_release(lmod4);
+  CHECK(sim.led_writes == 4 && !sim.leds[2]);
+
+  // Locking NEO_4 lights its LED once, and Mod3 on top of the lock keeps it.
+  sim_clear_log();
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(lmod4);
+  sim_release(rmod4);
+  CHECK(sim.led_writes == 1 && sim.leds[2]);
+  sim_press(lmod3);
+  sim_release(lmod3);
+  sim_wait(1000);
+  CHECK(sim.led_writes == 1);
+}
+
+static void test_dual_role_retro_tap(void) {
+  keypos_t ac = sim_key(NEO_1, YELDIR_AC);
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+
+  // Held alone, both send their tap keycode on release.
+  sim_press(ac);
+  sim_wait(YELDIR_AC_TAPPING_TERM);
+  sim_release(ac);
+  CHECK(presses_of(KC_TAB) == 1);
+  CHECK(mods_with(KC_TAB) == 0);
+
+  sim_press(lmod3);
+  sim_wait(NEO2_LMOD3_TAPPING_TERM);
+  sim_release(lmod3);
+  CHECK(presses_of(KC_ESC) == 1);
+
+  // Used as modifiers, they don't.
+  sim_clear_log();
+  sim_press(ac);
+  sim_tap(sim_key(NEO_1, DE_T));
+  sim_release(ac);
+  CHECK(presses_of(KC_TAB) == 0);
+  CHECK(mods_with(KC_T) == (MOD_BIT(KC_LCTL) | MOD_BIT(KC_LALT)));
+}
+
+static void test_rmod3(void) {
+  keypos_t rmod3 = sim_key(NEO_1, NEO2_RMOD3);
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+
+  sim_press(rmod3);
+  CHECK(neo2.current_layer == NEO_3);
+  sim_tap(sim_key(NEO_3, NEO2_L3_EXCLAMATION));
+  CHECK(mods_with(KC_1) == MOD_BIT(KC_LSFT));
+
+  sim_press(lmod4);
+  CHECK(neo2.current_layer == NEO_6);
+  sim_release(rmod3);
+  CHECK(neo2.current_layer == NEO_4);
+  sim_release(lmod4);
+  CHECK(neo2.current_layer == NEO_1);
+}
+
+static void test_compose(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+
+  sim_press(lmod3);
+  sim_tap(sim_key(NEO_3, NEO2_COMPOSE));
+  sim_release(lmod3);
+  sim_tap(sim_key(NEO_1, DE_O));
+  sim_tap(sim_key(NEO_1, DE_C));
+  CHECK(sim.unicode_count == 1);
+  CHECK(sim.unicode[0] == 0x00A9);
+  CHECK(presses_of(KC_O) == 0 && presses_of(KC_C) == 0 && presses_of(KC_ESC) == 0);
+
+  // Outside of a sequence the keys type again.
+  sim_tap(sim_key(NEO_1, DE_O));
+  CHECK(presses_of(KC_O) == 1);
+}
+
+static void test_compose_inputs(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  keypos_t compose = sim_key(NEO_3, NEO2_COMPOSE);
+  keypos_t ac = sim_key(NEO_1, YELDIR_AC);
+
+  // "- >" with the NEO_1 minus. The dual-role key in between isn't
+  // swallowed by the sequence.
+  sim_press(lmod3);
+  sim_tap(compose);
+  sim_release(lmod3);
+  sim_tap(sim_key(NEO_1, NEO2_MINUS));
+  sim_tap(ac);
+  CHECK(presses_of(KC_TAB) == 1);
+  sim_press(lmod3);
+  sim_tap(sim_key(NEO_3, NEO2_L3_GREATERTHAN));
+  sim_release(lmod3);
+  CHECK(sim.unicode_count == 1 && sim.unicode[0] == 0x2192);
+  CHECK(presses_of(KC_SLASH) == 0);
+
+  // Layer switches still work while a sequence is in progress.
+  sim_press(lmod3);
+  sim_tap(compose);
+  sim_release(lmod3);
+  sim_tap(sim_key(NEO_1, TO(DE_NORMAL)));
+  CHECK(neo2.current_layer == DE_NORMAL);
+}
+
+static void test_unicode_engine(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  keypos_t cent = sim_key(NEO_3, NEO2_L3_CENT);
+
+  sim_press(lmod3);
+  sim_tap(cent);
+  sim_release(lmod3);
+  CHECK(mods_with(KC_C) == MOD_BIT(KC_RALT));
+  CHECK(sim.unicode_count == 0);
+
+  hid_command(NEO2_HID_SET_UNICODE, 1);
+  sim_clear_log();
+  sim_press(lmod3);
+  sim_tap(cent);
+  sim_release(lmod3);
+  CHECK(presses_of(KC_C) == 0);
+  CHECK(sim.unicode_count == 1 && sim.unicode[0] == 0x00A2);
+}
+
+// Dead keys of the host layout are completed with a space, which is sent
+// without the modifiers of the dead key.
+static void test_dead_key_symbols(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  keypos_t circumflex = sim_key(NEO_3, NEO2_L3_CIRCUMFLEX);
+  keypos_t backtick = sim_key(NEO_3, NEO2_L3_BACKTICK);
+
+  sim_press(lmod3);
+  sim_clear_log();
+  sim_tap(circumflex);
+  CHECK(sim.report_count == 4);
+  CHECK(sim_report_has(&sim.reports[0], KC_GRAVE) && sim.reports[0].mods == 0);
+  CHECK(report_is_empty(&sim.reports[1]));
+  CHECK(sim_report_has(&sim.reports[2], KC_SPACE) && sim.reports[2].mods == 0);
+  CHECK(report_is_empty(sim_last_report()));
+
+  sim_clear_log();
+  sim_tap(backtick);
+  CHECK(mods_with(KC_EQL) == MOD_BIT(KC_LSFT));
+  CHECK(presses_of(KC_SPACE) == 1);
+  CHECK(mods_with(KC_SPACE) == 0);
+  CHECK(report_is_empty(sim_last_report()));
+  sim_release(lmod3);
+  CHECK(sim.unicode_count == 0);
+}
+
+static void test_numero_sign(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t numero = sim_key(NEO_4, NEO2_L3_NUMERO_SIGN);
+
+  sim_press(lmod4);
+  sim_tap(numero);
+  hid_command(NEO2_HID_SET_UNICODE, 1);
+  sim_tap(numero);
+  sim_release(lmod4);
+  CHECK(sim.unicode_count == 2 && sim.unicode[0] == 0x2116 && sim.unicode[1] == 0x2116);
+}
+
+static void test_numpad_modes(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t seven = sim_key(NEO_4, NEO2_NUM_7);
+
+  sim_press(lmod4);
+  sim_tap(seven);
+  CHECK(presses_of(KC_7) == 1);
+
+  hid_command(NEO2_HID_SET_NUMPAD, 1);
+  sim_clear_log();
+  sim_tap(seven);
+  sim_tap(seven);
+  sim_release(lmod4);
+  CHECK(presses_of(KC_NUM_LOCK) == 1);
+  CHECK(presses_of(KC_KP_7) == 2);
+  CHECK(presses_of(KC_7) == 0);
+
+  // A key held across a mode change is released as the key it was pressed as.
+  sim_press(lmod4);
+  sim_press(seven);
+  hid_command(NEO2_HID_SET_NUMPAD, 0);
+  sim_release(seven);
+  CHECK(report_is_empty(sim_last_report()));
+  sim_press(seven);
+  hid_command(NEO2_HID_SET_NUMPAD, 1);
+  sim_release(seven);
+  sim_release(lmod4);
+  CHECK(report_is_empty(sim_last_report()));
+}
+
+static void test_nav_repeat(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t up = sim_key(NEO_4, NEO2_NAV_UP);
+  keypos_t down = sim_key(NEO_4, NEO2_NAV_DOWN);
+
+  sim_press(lmod4);
+  sim_press(up);
+  sim_wait(NEO2_NAV_REPEAT_DELAY - 2);
+  CHECK(presses_of(KC_UP) == 1);
+  sim_wait(NEO2_NAV_REPEAT_INTERVAL);
+  CHECK(presses_of(KC_UP) == 2);
+
+  // The newer key takes over the repeat and hands it back on release.
+  sim_clear_log();
+  sim_press(down);
+  sim_wait(NEO2_NAV_REPEAT_DELAY);
+  CHECK(presses_of(KC_UP) == 0);
+  CHECK(presses_of(KC_DOWN) == 2);
+  sim_release(down);
+  sim_wait(NEO2_NAV_REPEAT_DELAY);
+  CHECK(presses_of(KC_UP) == 1);
+  CHECK(presses_of(KC_DOWN) == 2);
+
+  // Releasing an older key keeps the repeat going.
+  sim_press(down);
+  sim_release(up);
+  sim_clear_log();
+  sim_wait(NEO2_NAV_REPEAT_DELAY);
+  CHECK(presses_of(KC_DOWN) >= 1);
+  CHECK(presses_of(KC_UP) == 0);
+
+  sim_release(down);
+  sim_clear_log();
+  sim_wait(NEO2_NAV_REPEAT_DELAY);
+  CHECK(sim.report_count == 0);
+  sim_release(lmod4);
+}
+
+// Every report of a Shift selection moves the cursor: a press and a
+// release of the arrow per step, all with the held Shift.
+static bool selection_reports_ok(uint8_t keycode, size_t steps) {
+  if (sim.report_count != 2 * steps || presses_of(keycode) != steps) {
+    return false;
+  }
+  for (size_t i = 0; i < sim.report_count; i++) {
+    if (sim.reports[i].mods != MOD_BIT(KC_LSFT) || sim_report_has(&sim.reports[i], keycode) != !(i & 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void test_nav_selection(void) {
+  keypos_t shift = sim_key(NEO_1, KC_LSFT);
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t right = sim_key(NEO_4, NEO2_NAV_RIGHT);
+
+  sim_press(shift);
+  sim_press(lmod4);
+  sim_clear_log();
+  for (int i = 0; i < 200; i++) {
+    sim_tap(right);
+  }
+  CHECK(selection_reports_ok(KC_RIGHT, 200));
+
+  // The same with the keyboard repeating a held arrow.
+  sim_clear_log();
+  sim_press(right);
+  while (presses_of(KC_RIGHT) < 200) {
+    sim_wait(1);
+  }
+  sim_release(right);
+  sim_wait(NEO2_NAV_REPEAT_DELAY);
+  CHECK(selection_reports_ok(KC_RIGHT, 200));
+
+  sim_release(lmod4);
+  sim_release(shift);
+}
+
+static void test_de_normal(void) {
+  keypos_t one = sim_key(NEO_1, NEO2_1);
+
+  sim_tap(sim_key(NEO_1, TO(DE_NORMAL)));
+  CHECK(neo2.current_layer == DE_NORMAL);
+  CHECK(keymap_config.nkro);
+  CHECK(sim.leds[3]);
+
+  sim_clear_log();
+  sim_press(sim_key(DE_NORMAL, KC_LSFT));
+  sim_tap(one);
+  CHECK(mods_with(KC_1) == MOD_BIT(KC_LSFT));
+  CHECK(presses_of(KC_GRAVE) == 0);
+
+  sim_release(sim_key(DE_NORMAL, KC_LSFT));
+
+  // The mode is saved once the write delay passed.
+  sim_wait(NEO2_SETTINGS_WRITE_DELAY);
+  CHECK(sim.eeprom_writes == 1);
+  CHECK(((user_config_t){ .raw = sim.eeprom_user }).de_normal);
+
+  // FKEYS on top of DE_NORMAL still takes the fast path, so a shift pressed
+  // there doesn't get stuck in the caps combo when FKEYS goes first. The
+  // toggles on FKEYS keep working.
+  keypos_t fkeys = sim_key(DE_NORMAL, MO(FKEYS));
+  keypos_t rshift = sim_key(DE_NORMAL, KC_RSFT);
+  sim_clear_log();
+  sim_press(fkeys);
+  sim_press(rshift);
+  sim_release(fkeys);
+  sim_release(rshift);
+  sim_wait(2);
+  CHECK(!neo2.capslock_state);
+  CHECK(strstr(sim.console, "GUARD:") == NULL);
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, NEO2_UNICODE_TOGGLE));
+  sim_release(fkeys);
+  CHECK(neo2.unicode_output);
+}
+
+// Keys pressed on a Neo layer and released in DE_NORMAL skip the Neo path
+// on release, the mode switch has to clean up after them.
+static void test_de_normal_held_keys(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t rmod4 = sim_key(NEO_1, NEO2_RMOD4);
+  keypos_t up = sim_key(NEO_4, NEO2_NAV_UP);
+  keypos_t seven = sim_key(NEO_4, NEO2_NUM_7);
+
+  // Up held on a locked NEO_4 while TO(DE_NORMAL) is tapped through it.
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(rmod4);
+  sim_release(lmod4);
+  sim_press(up);
+  sim_tap(sim_key(NEO_1, TO(DE_NORMAL)));
+  CHECK(neo2.current_layer == DE_NORMAL);
+  sim_release(up);
+  sim_clear_log();
+  sim_wait(2000);
+  CHECK(presses_of(KC_UP) == 0);
+
+  // The same with the raw HID mode switch.
+  hid_command(NEO2_HID_SET_MODE, 0);
+  sim_press(lmod4);
+  sim_press(up);
+  hid_command(NEO2_HID_SET_MODE, 1);
+  sim_release(up);
+  sim_release(lmod4);
+  sim_clear_log();
+  sim_wait(2000);
+  CHECK(presses_of(KC_UP) == 0);
+
+  // A keypad key released in DE_NORMAL doesn't turn the next main block
+  // press of the key into a keypad release.
+  hid_command(NEO2_HID_SET_MODE, 0);
+  hid_command(NEO2_HID_SET_NUMPAD, 1);
+  sim_press(lmod4);
+  sim_press(seven);
+  hid_command(NEO2_HID_SET_MODE, 1);
+  sim_release(seven);
+  sim_release(lmod4);
+  CHECK(report_is_empty(sim_last_report()));
+  hid_command(NEO2_HID_SET_MODE, 0);
+  hid_command(NEO2_HID_SET_NUMPAD, 0);
+  sim_clear_log();
+  sim_press(lmod4);
+  sim_tap(seven);
+  sim_release(lmod4);
+  CHECK(presses_of(KC_7) == 1);
+  CHECK(report_is_empty(sim_last_report()));
+}
+
+static void test_settings_restore(void) {
+  for (uint32_t raw = 0; raw < 8; raw++) {
+    user_config_t config = { .raw = raw };
+    power_up(raw);
+    CHECK(neo2.de_normal_mode == config.de_normal);
+    CHECK(layer_state_cmp(layer_state, DE_NORMAL) == config.de_normal);
+    CHECK(sim.leds[3] == config.de_normal);
+    CHECK(neo2.unicode_output == config.unicode_output);
+    CHECK(neo2.keypad_numpad == config.keypad_numpad);
+
+    // Restoring the settings doesn't write them back.
+    sim_wait(NEO2_SETTINGS_WRITE_DELAY + 1);
+    CHECK(sim.eeprom_writes == 0);
+  }
+}
+
+static void test_settings_coalesced(void) {
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  keypos_t unicode = sim_key(FKEYS, NEO2_UNICODE_TOGGLE);
+  keypos_t numpad = sim_key(FKEYS, NEO2_NUMPAD_TOGGLE);
+
+  // Toggles less than the write delay apart are written once, after the
+  // delay has passed since the last one.
+  sim_press(fkeys);
+  for (int i = 0; i < 5; i++) {
+    sim_tap(unicode);
+    sim_tap(numpad);
+    sim_wait(NEO2_SETTINGS_WRITE_DELAY / 2);
+  }
+  sim_tap(numpad);
+  sim_release(fkeys);
+  CHECK(sim.eeprom_writes == 0);
+  sim_wait(NEO2_SETTINGS_WRITE_DELAY - 10);
+  CHECK(sim.eeprom_writes == 0);
+  sim_wait(10);
+  CHECK(sim.eeprom_writes == 1);
+  user_config_t config = { .raw = sim.eeprom_user };
+  CHECK(config.unicode_output && !config.keypad_numpad && !config.de_normal);
+
+  // Toggling back and forth within the delay leaves nothing to write.
+  sim_press(fkeys);
+  sim_tap(numpad);
+  sim_tap(numpad);
+  sim_release(fkeys);
+  sim_wait(NEO2_SETTINGS_WRITE_DELAY + 1);
+  CHECK(sim.eeprom_writes == 1);
+
+  // The saved settings come back on the next power up.
+  power_up(sim.eeprom_user);
+  CHECK(neo2.unicode_output && !neo2.keypad_numpad);
+}
+
+static void test_raw_hid(void) {
+  hid_command(NEO2_HID_GET_VERSION, 0);
+  CHECK(sim.raw_hid[0] == NEO2_HID_GET_VERSION);
+  CHECK(sim.raw_hid[1] == NEO2_HID_OK);
+  CHECK(sim.raw_hid[2] == NEO2_HID_PROTOCOL_VERSION);
+
+  // The keys down count comes from the matrix.
+  keypos_t t = sim_key(NEO_1, DE_T);
+  keypos_t n = sim_key(NEO_1, DE_N);
+  sim_press(t);
+  sim_press(n);
+  hid_command(NEO2_HID_GET_COUNTERS, 0);
+  CHECK(sim.raw_hid[1] == NEO2_HID_OK);
+  CHECK(sim.raw_hid[6] == 2);
+  sim_release(t);
+  sim_release(n);
+  hid_command(NEO2_HID_GET_COUNTERS, 0);
+  CHECK(sim.raw_hid[6] == 0);
+
+  hid_command(NEO2_HID_SET_MODE, 2);
+  CHECK(sim.raw_hid[1] == NEO2_HID_BAD_ARG);
+  hid_command(0x7F, 0);
+  CHECK(sim.raw_hid[1] == NEO2_HID_UNKNOWN_CMD);
+}
+
+static void test_idle_guard(void) {
+  keypos_t t = sim_key(NEO_1, DE_T);
+
+  // A layer left on by a bug is reset once the last key is up.
+  layer_on(NEO_3);
+  sim_press(t);
+  sim_wait(10);
+  CHECK(layer_state_cmp(layer_state, NEO_3));
+  sim_release(t);
+  sim_wait(2);
+  CHECK(strstr(sim.console, "GUARD:") != NULL);
+  CHECK(neo2.current_layer == NEO_1);
+
+  // A locked NEO_4 is fine.
+  sim_clear_log();
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t rmod4 = sim_key(NEO_1, NEO2_RMOD4);
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(rmod4);
+  sim_release(lmod4);
+  sim_wait(2);
+  CHECK(strstr(sim.console, "GUARD:") == NULL);
+  CHECK(neo2.current_layer == NEO_4);
+}
+
+// The dynamic macro code lets the DM_REC1 press through but swallows its
+// release, and passes the DM_RSTP release without its press.
+static void test_idle_guard_dynamic_macros(void) {
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  keypos_t t = sim_key(NEO_1, DE_T);
+
+  // Starting the recording clears the layers, so FKEYS has to be pressed
+  // again for the stop key.
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_REC1));
+  CHECK(neo2.current_layer == NEO_1);
+  sim_release(fkeys);
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_RSTP));
+  sim_tap(sim_key(FKEYS, DM_PLY1));
+  sim_wait(2);
+  CHECK(neo2.current_layer == FKEYS);
+  sim_release(fkeys);
+  sim_wait(2);
+  CHECK(neo2.current_layer == NEO_1);
+  CHECK(strstr(sim.console, "GUARD:") == NULL);
+
+  // The check still runs after the last key went up.
+  layer_on(NEO_3);
+  sim_tap(t);
+  sim_wait(2);
+  CHECK(strstr(sim.console, "GUARD:") != NULL);
+  CHECK(neo2.current_layer == NEO_1);
+}
+
+// A played macro sends the recorded reports, one event every
+// DYNAMIC_MACRO_DELAY ms, and leaves the layers and their holds as they
+// were.
+static void test_dynamic_macro_playback(void) {
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  keypos_t rmod3 = sim_key(NEO_1, NEO2_RMOD3);
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t rmod4 = sim_key(NEO_1, NEO2_RMOD4);
+
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_REC1));
+  sim_release(fkeys);
+  sim_clear_log();
+  sim_tap(sim_key(NEO_1, DE_H));
+  sim_press(rmod3);
+  sim_tap(sim_key(NEO_3, NEO2_L3_SLASH));
+  sim_release(rmod3);
+  static sim_report_t recorded[16];
+  size_t recorded_count = sim.report_count;
+  CHECK(recorded_count >= 3 && recorded_count <= 16);
+  memcpy(recorded, sim.reports, recorded_count * sizeof(recorded[0]));
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, DM_RSTP));
+  sim_release(fkeys);
+
+  // Played with NEO_4 locked, Mod3 and FKEYS held.
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(lmod4);
+  sim_release(rmod4);
+  sim_press(rmod3);
+  sim_press(fkeys);
+  sim_press(sim_key(FKEYS, DM_PLY1));
+  sim_clear_log();
+  uint32_t start = timer_read32();
+  sim_release(sim_key(FKEYS, DM_PLY1));
+
+  // Cleared before and after the macro.
+  CHECK(sim.report_count == recorded_count + 2);
+  CHECK(report_is_empty(&sim.reports[0]));
+  CHECK(report_is_empty(sim_last_report()));
+  for (size_t i = 0; i < recorded_count; i++) {
+    const sim_report_t *report = &sim.reports[i + 1];
+    CHECK(report->mods == recorded[i].mods);
+    CHECK(memcmp(report->keys, recorded[i].keys, sizeof(report->keys)) == 0);
+    CHECK((report->time - start) % DYNAMIC_MACRO_DELAY == 0);
+  }
+  // Seven events: the release of FKEYS after the record key, then h, Mod3
+  // and / down and up.
+  CHECK(sim_last_report()->time - start == 7 * DYNAMIC_MACRO_DELAY);
+
+  CHECK(neo2.current_layer == FKEYS);
+  sim_release(fkeys);
+  CHECK(neo2.current_layer == NEO_6);
+  sim_release(rmod3);
+  CHECK(neo2.current_layer == NEO_4);
+  CHECK(sim.leds[2]);
+  sim_press(lmod4);
+  sim_press(rmod4);
+  sim_release(lmod4);
+  sim_release(rmod4);
+  CHECK(neo2.current_layer == NEO_1);
+  sim_wait(2);
+  CHECK(strstr(sim.console, "GUARD:") == NULL);
+}
+
+// Fuzzing of the layer, modifier and mode state machines. A random trace
+// of key events, waits and raw HID mode switches is run from power-up, and
+// the idle invariant is checked whenever no key is down. A failing trace is
+// shrunk to a minimal one before it is reported.
+enum fuzz_ops { FUZZ_PRESS, FUZZ_RELEASE, FUZZ_TAP, FUZZ_WAIT, FUZZ_HID };
+
+typedef struct {
+  uint8_t  op;
+  uint8_t  arg;    // index into fuzz_keys[], raw HID command
+  uint16_t value;  // wait in ms, raw HID argument
+} fuzz_op_t;
+
+#define FUZZ_RANDOM_OPS 48
+#define FUZZ_TRACE_MAX  (FUZZ_RANDOM_OPS + MATRIX_ROWS * MATRIX_COLS)
+
+static keypos_t fuzz_keys[MATRIX_ROWS * MATRIX_COLS];
+static size_t fuzz_key_count;
+static size_t fuzz_events;
+
+// Keys that change layers, modifiers, modes or hold state on some layer.
+static bool fuzz_is_state_key(keypos_t key) {
+  static const uint8_t layers[] = { NEO_1, NEO_4, DE_NORMAL };
+  for (size_t i = 0; i < sizeof(layers); i++) {
+    uint16_t keycode = keymaps[layers[i]][key.row][key.col];
+    if (IS_MOD(keycode) || keycode == NEO2_LMOD3 || keycode == YELDIR_AC
+        || (keycode >= NEO2_RMOD3 && keycode <= NEO2_RMOD4)
+        || (keycode >= QK_TO && keycode <= QK_MOMENTARY_MAX)
+        || (keycode >= NEO2_NUM_0 && keycode <= NEO2_NAV_PGDN)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static const char *fuzz_idle_violation(void) {
+  layer_state_t allowed = 1 << NEO_1;
+  if (neo2.de_normal_mode) {
+    allowed |= 1 << DE_NORMAL;
+  }
+  if (neo2.layer_holds[NEO_4] & HOLD_LOCK) {
+    allowed |= 1 << NEO_4;
+  }
+
+  if (layer_state & ~allowed) return "layer left on";
+  if (layer_state_cmp(layer_state, DE_NORMAL) != neo2.de_normal_mode) return "mode out of sync";
+  if (get_mods()) return "modifier left on";
+  if (has_anykey()) return "key left in the report";
+  if (neo2.nav_held_count) return "navigation key still repeating";
+  if (neo2.numpad_keypad_held) return "keypad key still held";
+  if (neo2.capslock_state) return "shift still in the caps combo";
+  if (strstr(sim.console, "GUARD:")) return "guard fired";
+  return NULL;
+}
+
+// Run trace from power-up. Returns the index of the operation after which
+// the invariant broke, or -1. Presses of held keys and releases of keys
+// that are up are skipped, shrinking leaves those behind.
+static int fuzz_run(const fuzz_op_t *trace, size_t length, const char **violation) {
+  bool down[MATRIX_ROWS * MATRIX_COLS] = { false };
+  size_t down_count = 0;
+
+  power_up(0);
+  for (size_t i = 0; i < length; i++) {
+    const fuzz_op_t *op = &trace[i];
+    if (sim.report_count > SIM_MAX_REPORTS / 2 || sim.console_len > sizeof(sim.console) / 2) {
+      sim_clear_log();
+    }
+
+    switch (op->op) {
+      case FUZZ_PRESS:
+      case FUZZ_RELEASE:
+        if (down[op->arg] == (op->op == FUZZ_PRESS)) {
+          continue;
+        }
+        down[op->arg] = op->op == FUZZ_PRESS;
+        down_count += down[op->arg] ? 1 : -1;
+        if (down[op->arg]) {
+          sim_press(fuzz_keys[op->arg]);
+        } else {
+          sim_release(fuzz_keys[op->arg]);
+        }
+        fuzz_events++;
+        break;
+      case FUZZ_TAP:
+        if (down[op->arg]) {
+          continue;
+        }
+        sim_tap(fuzz_keys[op->arg]);
+        fuzz_events += 2;
+        break;
+      case FUZZ_WAIT:
+        sim_wait(op->value);
+        break;
+      case FUZZ_HID:
+        hid_command(op->arg, op->value);
+        break;
+    }
+
+    if (down_count == 0) {
+      const char *broken = fuzz_idle_violation();
+      if (broken) {
+        if (violation) {
+          *violation = broken;
+        }
+        return (int)i;
+      }
+    }
+  }
+  return -1;
+}
+
+// Random operations over a key pool in which the state keys are weighted
+// up, so chords of several layer and modifier keys are common. Keys still
+// down at the end are released.
+static size_t fuzz_generate(fuzz_op_t *trace, const uint8_t *pool, size_t pool_size) {
+  static const uint8_t hid_commands[] = { NEO2_HID_SET_MODE, NEO2_HID_SET_UNICODE, NEO2_HID_SET_NUMPAD };
+  bool down[MATRIX_ROWS * MATRIX_COLS] = { false };
+  size_t length = 0;
+
+  for (size_t i = 0; i < FUZZ_RANDOM_OPS; i++) {
+    int kind = rand() % 16;
+    uint8_t key = pool[(size_t)rand() % pool_size];
+    fuzz_op_t *op = &trace[length++];
+
+    if (kind < 12) {
+      op->op = down[key] ? FUZZ_RELEASE : (kind < 10 ? FUZZ_PRESS : FUZZ_TAP);
+      op->arg = key;
+      if (op->op != FUZZ_TAP) {
+        down[key] = !down[key];
+      }
+    } else if (kind < 15) {
+      op->op = FUZZ_WAIT;
+      op->value = (uint16_t)(kind == 14 ? rand() % 300 : rand() % 20);
+    } else {
+      op->op = FUZZ_HID;
+      op->arg = hid_commands[(size_t)rand() % sizeof(hid_commands)];
+      op->value = (uint16_t)(rand() % 2);
+    }
+  }
+
+  for (size_t key = 0; key < fuzz_key_count; key++) {
+    if (down[key]) {
+      trace[length++] = (fuzz_op_t){ .op = FUZZ_RELEASE, .arg = (uint8_t)key };
+    }
+  }
+  return length;
+}
+
+// Drop chunks of operations as long as the trace still fails, halving the
+// chunk size down to single operations, then shorten the waits.
+static size_t fuzz_shrink(fuzz_op_t *trace, size_t length) {
+  fuzz_op_t candidate[FUZZ_TRACE_MAX];
+
+  for (size_t chunk = length / 2; chunk > 0; chunk /= 2) {
+    bool removed = true;
+    while (removed) {
+      removed = false;
+      for (size_t start = 0; start + chunk <= length; start++) {
+        memcpy(candidate, trace, start * sizeof(fuzz_op_t));
+        memcpy(candidate + start, trace + start + chunk, (length - start - chunk) * sizeof(fuzz_op_t));
+        int failed = fuzz_run(candidate, length - chunk, NULL);
+        if (failed >= 0) {
+          length = (size_t)failed + 1;
+          memcpy(trace, candidate, length * sizeof(fuzz_op_t));
+          removed = true;
+          break;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    while (trace[i].op == FUZZ_WAIT && trace[i].value > 0) {
+      uint16_t value = trace[i].value;
+      trace[i].value = value / 2;
+      if (fuzz_run(trace, length, NULL) < 0) {
+        trace[i].value = value;
+        break;
+      }
+    }
+  }
+  return length;
+}
+
+static void fuzz_print(const fuzz_op_t *trace, size_t length) {
+  static const char *const names[] = { "press", "release", "tap", "wait", "hid" };
+
+  for (size_t i = 0; i < length; i++) {
+    const fuzz_op_t *op = &trace[i];
+    if (op->op == FUZZ_WAIT) {
+      fprintf(stderr, "  %-7s %u ms\n", names[op->op], op->value);
+    } else if (op->op == FUZZ_HID) {
+      fprintf(stderr, "  %-7s command: 0x%02X, arg: %u\n", names[op->op], op->arg, op->value);
+    } else {
+      keypos_t key = fuzz_keys[op->arg];
+      fprintf(stderr, "  %-7s row: %2u, col: %u, NEO_1: 0x%04X\n",
+              names[op->op], key.row, key.col, keymaps[NEO_1][key.row][key.col]);
+    }
+  }
+}
+
+// FUZZ_SEED and FUZZ_EVENTS in the environment pick another seed or a
+// longer run.
+static void test_idle_guard_random(void) {
+  uint8_t pool[MATRIX_ROWS * MATRIX_COLS * 8];
+  size_t pool_size = 0;
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      keypos_t key = { .col = col, .row = row };
+      bool used = false;
+      for (size_t layer = 0; layer < sizeof(keymaps) / sizeof(keymaps[0]); layer++) {
+        used |= keymaps[layer][row][col] != KC_NO;
+      }
+      if (!used) {
+        continue;
+      }
+      for (int weight = fuzz_is_state_key(key) ? 8 : 1; weight > 0; weight--) {
+        pool[pool_size++] = (uint8_t)fuzz_key_count;
+      }
+      fuzz_keys[fuzz_key_count++] = key;
+    }
+  }
+
+  unsigned seed = getenv("FUZZ_SEED") ? (unsigned)strtoul(getenv("FUZZ_SEED"), NULL, 0) : 22;
+  size_t target = getenv("FUZZ_EVENTS") ? strtoul(getenv("FUZZ_EVENTS"), NULL, 0) : 300000;
+  struct timespec start, end;
+
+  srand(seed);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (fuzz_events < target) {
+    fuzz_op_t trace[FUZZ_TRACE_MAX];
+    size_t length = fuzz_generate(trace, pool, pool_size);
+    const char *violation = NULL;
+    int failed = fuzz_run(trace, length, &violation);
+
+    if (failed >= 0) {
+      length = fuzz_shrink(trace, (size_t)failed + 1);
+      fuzz_run(trace, length, &violation);
+      fprintf(stderr, "fuzz: %s after this trace from power-up (seed %u):\n", violation, seed);
+      fuzz_print(trace, length);
+      if (strstr(sim.console, "GUARD:")) {
+        fprintf(stderr, "%s", strstr(sim.console, "GUARD:"));
+      }
+      CHECK(false);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("     %zu key events in %.2f s, %.2f M events/s\n",
+         fuzz_events, seconds, fuzz_events / seconds / 1e6);
+}
+
+// Time of the first report holding keycode.
+static uint32_t time_of(uint8_t keycode) {
+  for (size_t i = 0; i < sim.report_count; i++) {
+    if (sim_report_has(&sim.reports[i], keycode)) {
+      return sim.reports[i].time;
+    }
+  }
+  return UINT32_MAX;
+}
+
+static void test_trace_replay(void) {
+  keypos_t lmod3 = sim_key(NEO_1, NEO2_LMOD3);
+  keypos_t paren = sim_key(NEO_3, NEO2_L3_LPARENTHESES);
+  static const struct {
+    bool mod3;
+    uint16_t keycode;
+    bool pressed;
+    uint16_t time;
+  } events[] = {
+    // Mod3 tapped, then held for a parenthesis across the timer wrap.
+    { true, NEO2_LMOD3, true, 65500 },
+    { true, NEO2_LMOD3, false, 65530 },
+    { true, NEO2_LMOD3, true, 65535 },
+    { false, NEO2_L3_LPARENTHESES, true, 85 },
+    { false, NEO2_L3_LPARENTHESES, false, 120 },
+    { true, NEO2_LMOD3, false, 300 },
+  };
+
+  char trace[1024] = "Ergodox Infinity: session start\n";
+  for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++) {
+    keypos_t key = events[i].mod3 ? lmod3 : paren;
+    size_t len = strlen(trace);
+    snprintf(trace + len, sizeof(trace) - len, "KL: kc: 0x%04X, col: %2u, row: %2u, pressed: %u, time: %5u\n",
+             events[i].keycode, key.col, key.row, events[i].pressed, events[i].time);
+  }
+
+  sim_wait(1000);
+  sim_clear_log();
+  FILE *file = fmemopen(trace, strlen(trace), "r");
+  CHECK(sim_replay(file) == 6);
+  fclose(file);
+
+  CHECK(presses_of(KC_ESC) == 1);
+  CHECK(presses_of(KC_8) == 1);
+  CHECK(mods_with(KC_8) == MOD_BIT(KC_LSFT));
+  CHECK(report_is_empty(sim_last_report()));
+  uint32_t start = time_of(KC_ESC);
+  CHECK(start >= 1000);
+  CHECK(time_of(KC_8) - start == 121);
+  CHECK(layer_state == 0);
+
+  // The tap is decided by its release, the hold by the next press.
+  CHECK(sim.tap_decisions[30] == 1);
+  CHECK(sim.hold_decisions[86] == 1);
+}
+
+#ifdef NEO2_HEATMAP
+static void test_heatmap(void) {
+  keypos_t lmod4 = sim_key(NEO_1, NEO2_LMOD4);
+  keypos_t shift = sim_key(NEO_1, KC_LSFT);
+  keypos_t seven = sim_key(NEO_4, NEO2_NUM_7);
+
+  sim_press(lmod4);
+  sim_tap(shift);
+  sim_tap(seven);
+  sim_release(lmod4);
+
+  // Shift is transparent on NEO_4 and counts for NEO_1.
+  CHECK(heatmap_presses[NEO_1][shift.row][shift.col] == 1);
+  CHECK(heatmap_presses[NEO_4][shift.row][shift.col] == 0);
+  CHECK(heatmap_presses[NEO_4][seven.row][seven.col] == 1);
+  CHECK(heatmap_presses[NEO_1][lmod4.row][lmod4.col] == 1);
+
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  sim_press(fkeys);
+  sim_tap(sim_key(FKEYS, NEO2_DUMP_STATS));
+  sim_release(fkeys);
+  CHECK(strstr(sim.console, "LAYER: time:") != NULL);
+}
+#endif
+
+#ifdef NEO2_PROFILE
+static void test_profile(void) {
+  keypos_t one = sim_key(NEO_1, NEO2_1);
+  keypos_t fkeys = sim_key(NEO_1, MO(FKEYS));
+  keypos_t stats = sim_key(FKEYS, NEO2_DUMP_STATS);
+
+  for (int i = 0; i < 50; i++) {
+    sim_tap(one);
+    sim_wait(98);
+  }
+  sim_press(fkeys);
+  sim_clear_log();
+  sim_tap(stats);
+  sim_release(fkeys);
+
+  char line[64];
+  snprintf(line, sizeof(line), "PROF: kc: 0x%04X, n: 100,", NEO2_1);
+  CHECK(strstr(sim.console, line) != NULL);
+  CHECK(strstr(sim.console, "PROF: event, n: 101,") != NULL);
+  CHECK(strstr(sim.console, "PROF: scan, n: ") != NULL);
+  CHECK(strstr(sim.console, "PROF: run: 101 events in 5000 ms, 20 events/s, worst: ") != NULL);
+  CHECK(strstr(sim.console, " ns\n") != NULL);
+
+  // Every dump starts a new run, which holds the Stats and FKEYS events.
+  sim_press(fkeys);
+  sim_clear_log();
+  sim_tap(stats);
+  sim_release(fkeys);
+  CHECK(strstr(sim.console, line) == NULL);
+  CHECK(strstr(sim.console, "PROF: event, n: 4,") != NULL);
+}
+#endif
+
+// Every custom keycode has to do something when pressed: send a report,
+// type a codepoint, switch a layer or change a mode. NEO2_DUMP_STATS only
+// prints when a debug feature is built in.
+static bool custom_keycode_has_effect(uint16_t keycode) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    keyrecord_t record = { .event = { .key = { 0, 0 }, .pressed = true } };
+    layer_state_t layers = layer_state;
+    bool modes = neo2.unicode_output ^ neo2.keypad_numpad;
+
+    process_record_user(keycode, &record);
+    exit(sim.report_count || sim.unicode_count || layer_state != layers
+         || neo2.compose_count || (neo2.unicode_output ^ neo2.keypad_numpad) != modes ? 0 : 1);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void test_custom_keycodes_handled(void) {
+  for (uint16_t keycode = PLACEHOLDER + 1; keycode < CUSTOM_KEYCODES_END; keycode++) {
+    if (keycode != NEO2_DUMP_STATS && !custom_keycode_has_effect(keycode)) {
+      fprintf(stderr, "custom keycode 0x%04X has no effect\n", keycode);
+      CHECK(false);
+    }
+  }
+}
+
+// Every custom keycode also has to be on a layer.
+static void test_custom_keycodes_placed(void) {
+  for (uint16_t keycode = PLACEHOLDER + 1; keycode < CUSTOM_KEYCODES_END; keycode++) {
+    bool placed = false;
+    for (size_t layer = 0; layer < sizeof(keymaps) / sizeof(keymaps[0]); layer++) {
+      for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+          placed |= keymaps[layer][row][col] == keycode;
+        }
+      }
+    }
+    if (!placed) {
+      fprintf(stderr, "custom keycode 0x%04X is on no layer\n", keycode);
+      CHECK(false);
+    }
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*run)(void);
+} tests[] = {
+  { "shifted_digit", test_shifted_digit },
+  { "caps_combo", test_caps_combo },
+  { "caps_combo_chord_events", test_caps_combo_chord_events },
+  { "mod4_lock", test_mod4_lock },
+  { "led_writes", test_led_writes },
+  { "dual_role_retro_tap", test_dual_role_retro_tap },
+  { "rmod3", test_rmod3 },
+  { "compose", test_compose },
+  { "compose_inputs", test_compose_inputs },
+  { "unicode_engine", test_unicode_engine },
+  { "dead_key_symbols", test_dead_key_symbols },
+  { "numero_sign", test_numero_sign },
+  { "numpad_modes", test_numpad_modes },
+  { "nav_repeat", test_nav_repeat },
+  { "nav_selection", test_nav_selection },
+  { "de_normal", test_de_normal },
+  { "de_normal_held_keys", test_de_normal_held_keys },
+  { "settings_restore", test_settings_restore },
+  { "settings_coalesced", test_settings_coalesced },
+  { "raw_hid", test_raw_hid },
+  { "idle_guard", test_idle_guard },
+  { "idle_guard_dynamic_macros", test_idle_guard_dynamic_macros },
+  { "dynamic_macro_playback", test_dynamic_macro_playback },
+  { "idle_guard_random", test_idle_guard_random },
+  { "trace_replay", test_trace_replay },
+  { "custom_keycodes_handled", test_custom_keycodes_handled },
+  { "custom_keycodes_placed", test_custom_keycodes_placed },
+#ifdef NEO2_HEATMAP
+  { "heatmap", test_heatmap },
+#endif
+#ifdef NEO2_PROFILE
+  { "profile", test_profile },
+#endif
+};
+
+int main(void) {
+  int failed = 0;
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      sim_init(0);
+      tests[i].run();
+      exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("%s %s\n", ok ? "ok  " : "FAIL", tests[i].name);
+    failed += !ok;
+  }
+
+  printf("%d of %zu tests failed\n", failed, sizeof(tests) / sizeof(tests[0]));
+  return failed ? 1 : 0;
+}